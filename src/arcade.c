@@ -0,0 +1,604 @@
+/*
+ * arcade.c
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <ncurses.h>
+
+#include "arcade.h"
+#include "game.h"
+#include "invaders_config.h"
+#include "metrics.h"
+#include "render.h"
+#include "score_store.h"
+#include "sprite.h"
+#include "utility.h"
+
+enum arcade_event_source {
+  TIMER_EVENT_SOURCE = 0,
+  SIGNAL_EVENT_SOURCE,
+  TERMINAL_EVENT_SOURCE,
+  MASTER_EVENT_SOURCE,
+};
+
+struct arcade_session {
+  const char *ttypath;
+  int fd;
+  int master_fd;
+  FILE *terminal;
+  SCREEN *screen;
+  bool active;
+  struct game_session game_session;
+  struct key_input keys[ARCADE_KEY_QUEUE_SIZE];
+  int key_head;
+  int n_keys;
+  long n_ticks;
+  long cpu_nsec;
+  long output_bytes;
+};
+
+struct arcade {
+  int epoll_fd;
+  int timer_fd;
+  int signal_fd;
+  int n_sessions;
+  int n_active_sessions;
+  struct arcade_session sessions[ARCADE_MAX_SESSIONS];
+  struct sprite_atlas atlas;
+  struct render_buffer render_buffer;
+  struct score_store score_store;
+  struct score_store *opened_score_store;
+  struct logger error_logger;
+  struct logger stats_logger;
+  struct latency_histogram key_latency;
+  struct metrics metrics;
+  struct metrics_shard *metrics_shard;
+  long publish_nsec;
+};
+
+static uint64_t make_event_tag(enum arcade_event_source source, int index) {
+  return ((uint64_t) source << 32) | (uint32_t) index;
+}
+
+static bool watch_fd(struct arcade *arcade, int fd,
+                     enum arcade_event_source source, int index) {
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = make_event_tag(source, index);
+  if (-1 == epoll_ctl(arcade->epoll_fd, EPOLL_CTL_ADD, fd, &event)) {
+    emit_log(&arcade->error_logger,
+             "Failed to watch the descriptor: fd=%d, errno=%d", fd, errno);
+    return false;
+  }
+  return true;
+}
+
+static void push_session_key(struct arcade_session *session, int key) {
+  struct key_input *input;
+
+  if (ARCADE_KEY_QUEUE_SIZE > session->n_keys) {
+    input = &session->keys[(session->key_head + session->n_keys)
+        % ARCADE_KEY_QUEUE_SIZE];
+    input->key = key;
+    input->read_nsec = get_clock_nsec(CLOCK_MONOTONIC);
+    ++session->n_keys;
+  }
+}
+
+/**
+ * Pop the next key, keeping the time it was read at until the frame is out
+ */
+static int pop_session_key(struct arcade_session *session, long *read_nsecs,
+                           int *n_read_nsecs) {
+  struct key_input *input;
+
+  if (0 == session->n_keys) {
+    return ERR;
+  }
+  input = &session->keys[session->key_head];
+  read_nsecs[(*n_read_nsecs)++] = input->read_nsec;
+  session->key_head = (session->key_head + 1) % ARCADE_KEY_QUEUE_SIZE;
+  --session->n_keys;
+  return input->key;
+}
+
+/**
+ * Open the terminal and set up a ncurses screen of its own on it
+ */
+static bool open_arcade_session(struct arcade *arcade, const char *ttypath,
+                                const char *termtype, int master_fd) {
+  struct arcade_session *session;
+
+  if (ARCADE_MAX_SESSIONS <= arcade->n_sessions) {
+    emit_log(&arcade->error_logger, "Too many arcade sessions: max=%d",
+             ARCADE_MAX_SESSIONS);
+    return false;
+  }
+  session = &arcade->sessions[arcade->n_sessions];
+  memset(session, 0, sizeof(*session));
+  session->ttypath = ttypath;
+  session->master_fd = master_fd;
+  session->fd = open(ttypath, O_RDWR | O_NOCTTY);
+  if (-1 == session->fd) {
+    emit_log(&arcade->error_logger,
+             "Failed to open the terminal: path=%s, errno=%d", ttypath, errno);
+    return false;
+  }
+  session->terminal = fdopen(session->fd, "r+");
+  if (NULL == session->terminal) {
+    emit_log(&arcade->error_logger,
+             "Failed to open the terminal stream: path=%s", ttypath);
+    close(session->fd);
+    return false;
+  }
+  session->screen = newterm(termtype, session->terminal, session->terminal);
+  if (NULL == session->screen) {
+    emit_log(&arcade->error_logger, "Failed to set up the screen: path=%s",
+             ttypath);
+    fclose(session->terminal);
+    return false;
+  }
+  set_term(session->screen);
+  if (!setup_game_screen(stdscr, &arcade->error_logger)) {
+    endwin();
+    delscreen(session->screen);
+    fclose(session->terminal);
+    return false;
+  }
+  if (!watch_fd(arcade, session->fd, TERMINAL_EVENT_SOURCE,
+                arcade->n_sessions)) {
+    endwin();
+    delscreen(session->screen);
+    fclose(session->terminal);
+    return false;
+  }
+  reset_game_session(&session->game_session,
+                     (unsigned int) (time(NULL) ^ arcade->n_sessions),
+                     arcade->opened_score_store);
+  session->game_session.metrics = arcade->metrics_shard;
+  session->active = true;
+  ++arcade->n_sessions;
+  ++arcade->n_active_sessions;
+  return true;
+}
+
+static void close_arcade_session(struct arcade *arcade,
+                                 struct arcade_session *session) {
+  if (session->active) {
+    epoll_ctl(arcade->epoll_fd, EPOLL_CTL_DEL, session->fd, NULL);
+    set_term(session->screen);
+    endwin();
+    delscreen(session->screen);
+    fclose(session->terminal);
+    session->active = false;
+    --arcade->n_active_sessions;
+  }
+  if (0 <= session->master_fd) {
+    close(session->master_fd);
+    session->master_fd = -1;
+  }
+}
+
+static void receive_session_keys(struct arcade *arcade,
+                                 struct arcade_session *session,
+                                 uint32_t events) {
+  int key;
+  long cpu_start_nsec;
+
+  if (!session->active) {
+    return;
+  }
+  if (0 != (events & (EPOLLHUP | EPOLLERR))) {
+    close_arcade_session(arcade, session);
+    return;
+  }
+  cpu_start_nsec = get_clock_nsec(CLOCK_THREAD_CPUTIME_ID);
+  set_term(session->screen);
+  while (ERR != (key = getch())) {
+    push_session_key(session, key);
+  }
+  session->cpu_nsec += get_clock_nsec(CLOCK_THREAD_CPUTIME_ID)
+      - cpu_start_nsec;
+}
+
+static void drain_session_master(struct arcade_session *session) {
+  char scratch[4096];
+  ssize_t n_read;
+
+  while (0 < (n_read = read(session->master_fd, scratch, sizeof(scratch)))) {
+    session->output_bytes += n_read;
+  }
+}
+
+/**
+ * Advance every active session by the given number of frames and render it
+ * once, charging the CPU time spent to the session
+ */
+static void tick_arcade(struct arcade *arcade, long n_frames) {
+  int i, k, n_read_nsecs, level_speed, n_active_bullets;
+  long j, cpu_start_nsec, read_nsecs[ARCADE_KEY_QUEUE_SIZE], written_bytes;
+  struct arcade_session *session;
+
+  level_speed = 0;
+  n_active_bullets = 0;
+  written_bytes = read_output_meter(arcade->metrics_shard);
+  for (i = 0; i < arcade->n_sessions; ++i) {
+    session = &arcade->sessions[i];
+    if (!session->active) {
+      continue;
+    }
+    cpu_start_nsec = get_clock_nsec(CLOCK_THREAD_CPUTIME_ID);
+    set_term(session->screen);
+    n_read_nsecs = 0;
+    for (j = 0; j < n_frames; ++j) {
+      update_game_session(&session->game_session,
+                          pop_session_key(session, read_nsecs, &n_read_nsecs),
+                          IDEAL_FRAME_TIME);
+    }
+    erase();
+    draw_game_session(&session->game_session, &arcade->atlas,
+                      &arcade->render_buffer);
+    flush_render_buffer(&arcade->render_buffer, stdscr);
+    refresh();
+    for (k = 0; k < n_read_nsecs; ++k) {
+      count_latency(&arcade->key_latency,
+                    (get_clock_nsec(CLOCK_MONOTONIC) - read_nsecs[k]) / 1000L);
+    }
+    session->n_ticks += n_frames;
+    count_metric(arcade->metrics_shard, FRAMES_RENDERED_METRIC, 1L);
+    count_metric(arcade->metrics_shard, LATE_FRAMES_METRIC, n_frames - 1L);
+    if (INGAME_SCENE == session->game_session.scene) {
+      if (level_speed < get_game_level_speed(&session->game_session.game)) {
+        level_speed = get_game_level_speed(&session->game_session.game);
+      }
+      n_active_bullets += count_active_bullets(&session->game_session.game);
+    }
+    session->cpu_nsec += get_clock_nsec(CLOCK_THREAD_CPUTIME_ID)
+        - cpu_start_nsec;
+    if (0 <= session->master_fd) {
+      drain_session_master(session);
+    }
+  }
+
+  /* The fastest level of all, and the bullets of all */
+  count_metric(arcade->metrics_shard, OUTPUT_BYTES_METRIC,
+               read_output_meter(arcade->metrics_shard) - written_bytes);
+  set_metric(arcade->metrics_shard, LEVEL_SPEED_METRIC, level_speed);
+  set_metric(arcade->metrics_shard, ACTIVE_BULLETS_METRIC, n_active_bullets);
+  if (arcade->publish_nsec <= get_clock_nsec(CLOCK_MONOTONIC)) {
+    arcade->publish_nsec = get_clock_nsec(CLOCK_MONOTONIC)
+        + METRICS_PUBLISH_INTERVAL * 1000000L;
+    if (!publish_metrics(&arcade->metrics)) {
+      emit_log(&arcade->error_logger, "Failed to publish the metrics: path=%s",
+               arcade->metrics.path);
+    }
+  }
+}
+
+/**
+ * Dispatch the ready events, and return false when the arcade should close
+ */
+static bool dispatch_arcade_events(struct arcade *arcade, int timeout_msec) {
+  int i, n_events, index;
+  uint64_t n_expirations;
+  struct signalfd_siginfo siginfo;
+  struct epoll_event events[ARCADE_MAX_EVENTS];
+
+  n_events = epoll_wait(arcade->epoll_fd, events, N_ELEMENTS(events),
+                        timeout_msec);
+  if (-1 == n_events) {
+    if (EINTR == errno) {
+      return true;
+    }
+    emit_log(&arcade->error_logger, "Failed to wait for the events: errno=%d",
+             errno);
+    return false;
+  }
+  for (i = 0; i < n_events; ++i) {
+    index = (int) (events[i].data.u64 & 0xffffffffU);
+    switch ((enum arcade_event_source) (events[i].data.u64 >> 32)) {
+      case TIMER_EVENT_SOURCE:
+        if (sizeof(n_expirations)
+            == read(arcade->timer_fd, &n_expirations, sizeof(n_expirations))) {
+          tick_arcade(arcade, (long) n_expirations);
+        }
+        break;
+      case SIGNAL_EVENT_SOURCE:
+        if (-1 != read(arcade->signal_fd, &siginfo, sizeof(siginfo))) {
+          return false;
+        }
+        break;
+      case TERMINAL_EVENT_SOURCE:
+        receive_session_keys(arcade, &arcade->sessions[index],
+                             events[i].events);
+        break;
+      case MASTER_EVENT_SOURCE:
+        drain_session_master(&arcade->sessions[index]);
+        break;
+    }
+  }
+  return 0 < arcade->n_active_sessions;
+}
+
+static struct arcade *open_arcade(void) {
+  struct arcade *arcade;
+  sigset_t signals;
+
+  arcade = calloc(1, sizeof(*arcade));
+  if (NULL == arcade) {
+    return NULL;
+  }
+  reset_logger(&arcade->error_logger, ERRORLOG_FILEPATH);
+  reset_logger(&arcade->stats_logger, STATSLOG_FILEPATH);
+  reset_render_buffer(&arcade->render_buffer);
+  reset_latency_histogram(&arcade->key_latency);
+  reset_metrics(&arcade->metrics, METRICS_FILEPATH_FORMAT);
+  arcade->metrics_shard = claim_metrics_shard(&arcade->metrics, "arcade");
+  open_output_meter(arcade->metrics_shard);
+  compose_sprite_atlas(&arcade->atlas);
+  arcade->timer_fd = -1;
+  arcade->signal_fd = -1;
+  arcade->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (-1 == arcade->epoll_fd) {
+    emit_log(&arcade->error_logger, "Failed to create the event loop: errno=%d",
+             errno);
+    return arcade;
+  }
+
+  /* Receive the termination as an event, not as an interruption */
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGHUP);
+  sigprocmask(SIG_BLOCK, &signals, NULL);
+  arcade->signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (-1 == arcade->signal_fd
+      || !watch_fd(arcade, arcade->signal_fd, SIGNAL_EVENT_SOURCE, 0)) {
+    emit_log(&arcade->error_logger, "Failed to watch the signals: errno=%d",
+             errno);
+  }
+  return arcade;
+}
+
+static void report_arcade(struct arcade *arcade, FILE *stream) {
+  int i;
+  long n_ticks, cpu_nsec;
+  struct arcade_session *session;
+
+  n_ticks = 0L;
+  cpu_nsec = 0L;
+  for (i = 0; i < arcade->n_sessions; ++i) {
+    session = &arcade->sessions[i];
+    emit_log(&arcade->stats_logger,
+             "Arcade session: path=%s, ticks=%ld, cpu_msec=%.3f, "
+             "cpu_usec_per_tick=%.3f, output_bytes=%ld",
+             session->ttypath, session->n_ticks, session->cpu_nsec / 1e6,
+             (0L < session->n_ticks) ?
+                 session->cpu_nsec / 1e3 / session->n_ticks : 0.0,
+             session->output_bytes);
+    n_ticks += session->n_ticks;
+    cpu_nsec += session->cpu_nsec;
+  }
+  if (0L < n_ticks) {
+    emit_log(&arcade->stats_logger,
+             "Arcade total: sessions=%d, ticks=%ld, cpu_usec_per_tick=%.3f, "
+             "sessions_per_core=%.1f, game_bytes=%zu",
+             arcade->n_sessions, n_ticks, cpu_nsec / 1e3 / n_ticks,
+             IDEAL_FRAME_TIME * 1e6 * n_ticks / cpu_nsec,
+             sizeof(struct invaders_game));
+    if (NULL != stream) {
+      fprintf(stream,
+              "sessions=%d ticks=%ld cpu_usec_per_session_tick=%.3f "
+              "sessions_per_core_at_%ldms=%.1f game_bytes=%zu\n",
+              arcade->n_sessions, n_ticks, cpu_nsec / 1e3 / n_ticks,
+              IDEAL_FRAME_TIME, IDEAL_FRAME_TIME * 1e6 * n_ticks / cpu_nsec,
+              sizeof(struct invaders_game));
+    }
+  }
+  emit_latency_histogram(&arcade->stats_logger, "arcade_key_to_screen",
+                         &arcade->key_latency);
+  if (NULL != stream && 0L < arcade->key_latency.n_samples) {
+    fprintf(stream,
+            "key_to_screen_latency: samples=%ld p50_usec=%ld p99_usec=%ld "
+            "max_usec=%ld\n",
+            arcade->key_latency.n_samples,
+            get_latency_percentile(&arcade->key_latency, 0.50),
+            get_latency_percentile(&arcade->key_latency, 0.99),
+            arcade->key_latency.max_usec);
+  }
+}
+
+static void close_arcade(struct arcade *arcade) {
+  int i;
+
+  for (i = 0; i < arcade->n_sessions; ++i) {
+    close_arcade_session(arcade, &arcade->sessions[i]);
+  }
+  if (-1 != arcade->timer_fd) {
+    close(arcade->timer_fd);
+  }
+  if (-1 != arcade->signal_fd) {
+    close(arcade->signal_fd);
+  }
+  if (-1 != arcade->epoll_fd) {
+    close(arcade->epoll_fd);
+  }
+  if (NULL != arcade->opened_score_store) {
+    close_score_store(arcade->opened_score_store);
+  }
+  close_output_meter(arcade->metrics_shard);
+  publish_metrics(&arcade->metrics);
+  retract_metrics(&arcade->metrics);
+  close_logger(&arcade->stats_logger);
+  close_logger(&arcade->error_logger);
+  free(arcade);
+}
+
+int run_arcade(int argc, char **argv) {
+  int i, status;
+  struct arcade *arcade;
+  struct itimerspec interval;
+
+  if (1 > argc) {
+    fprintf(stderr, "usage: invaders --arcade <tty> [<tty> ...]\n");
+    return 2;
+  }
+  arcade = open_arcade();
+  if (NULL == arcade) {
+    return 1;
+  }
+  status = 1;
+  if (-1 == arcade->epoll_fd) {
+    goto cleanup;
+  }
+  if (open_score_store(&arcade->score_store, SCORE_STORE_FILEPATH)) {
+    arcade->opened_score_store = &arcade->score_store;
+  } else {
+    emit_log(&arcade->error_logger, "Failed to open the score store: path=%s",
+             SCORE_STORE_FILEPATH);
+  }
+  for (i = 0; i < argc; ++i) {
+    if (!open_arcade_session(arcade, argv[i], NULL, -1)) {
+      goto cleanup;
+    }
+  }
+
+  /* All the sessions share one frame clock */
+  arcade->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                    TFD_NONBLOCK | TFD_CLOEXEC);
+  memset(&interval, 0, sizeof(interval));
+  interval.it_interval.tv_nsec = IDEAL_FRAME_TIME * 1000000L;
+  interval.it_value.tv_nsec = IDEAL_FRAME_TIME * 1000000L;
+  if (-1 == arcade->timer_fd
+      || -1 == timerfd_settime(arcade->timer_fd, 0, &interval, NULL)
+      || !watch_fd(arcade, arcade->timer_fd, TIMER_EVENT_SOURCE, 0)) {
+    emit_log(&arcade->error_logger, "Failed to set up the frame clock: errno=%d",
+             errno);
+    goto cleanup;
+  }
+  while (dispatch_arcade_events(arcade, -1)) {
+  }
+  status = 0;
+
+ cleanup:
+  report_arcade(arcade, NULL);
+  close_arcade(arcade);
+  return status;
+}
+
+/**
+ * Create a pseudo-terminal pair, returning the master and the slave path
+ */
+static int open_benchmark_pty(char *slave_path, size_t slave_path_size) {
+  int master_fd;
+  struct winsize size;
+
+  master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (-1 == master_fd) {
+    return -1;
+  }
+  if (-1 == grantpt(master_fd) || -1 == unlockpt(master_fd)
+      || 0 != ptsname_r(master_fd, slave_path, slave_path_size)) {
+    close(master_fd);
+    return -1;
+  }
+  memset(&size, 0, sizeof(size));
+  size.ws_row = ARCADE_BENCHMARK_SCREEN_SIZE_X;
+  size.ws_col = ARCADE_BENCHMARK_SCREEN_SIZE_Y;
+  ioctl(master_fd, TIOCSWINSZ, &size);
+  fcntl(master_fd, F_SETFL, fcntl(master_fd, F_GETFL) | O_NONBLOCK);
+  return master_fd;
+}
+
+int run_arcade_benchmark(int argc, char **argv) {
+  static const char benchmark_keys[] = { 'w', 'a', 'd', 'w', 'd', 'a', 0, 0 };
+  int i, status, master_fd, n_sessions;
+  long tick, n_ticks, wall_start_nsec, cpu_start_nsec;
+  char key, (*slave_paths)[64];
+  struct arcade *arcade;
+
+  if (1 > argc) {
+    fprintf(stderr, "usage: invaders --arcade-bench <n_sessions> [n_ticks]\n");
+    return 2;
+  }
+  n_sessions = atoi(argv[0]);
+  n_ticks = (2 <= argc) ? atol(argv[1]) : ARCADE_BENCHMARK_DEFAULT_TICKS;
+  if (0 >= n_sessions || ARCADE_MAX_SESSIONS < n_sessions || 0L >= n_ticks) {
+    fprintf(stderr, "invalid benchmark size: sessions=1..%d, ticks>0\n",
+            ARCADE_MAX_SESSIONS);
+    return 2;
+  }
+  slave_paths = calloc(n_sessions, sizeof(*slave_paths));
+  arcade = open_arcade();
+  if (NULL == arcade || NULL == slave_paths) {
+    free(slave_paths);
+    return 1;
+  }
+  status = 1;
+  if (-1 == arcade->epoll_fd) {
+    goto cleanup;
+  }
+  for (i = 0; i < n_sessions; ++i) {
+    master_fd = open_benchmark_pty(slave_paths[i], sizeof(slave_paths[i]));
+    if (-1 == master_fd) {
+      emit_log(&arcade->error_logger,
+               "Failed to open the pseudo-terminal: errno=%d", errno);
+      goto cleanup;
+    }
+    if (!open_arcade_session(arcade, slave_paths[i], ARCADE_BENCHMARK_TERM,
+                             master_fd)) {
+      close(master_fd);
+      goto cleanup;
+    }
+    if (!watch_fd(arcade, master_fd, MASTER_EVENT_SOURCE, i)) {
+      goto cleanup;
+    }
+    drain_session_master(&arcade->sessions[i]);
+  }
+
+  /* Run the frames back to back, playing as an idle-free player would */
+  wall_start_nsec = get_clock_nsec(CLOCK_MONOTONIC);
+  cpu_start_nsec = get_clock_nsec(CLOCK_PROCESS_CPUTIME_ID);
+  for (tick = 0L; tick < n_ticks; ++tick) {
+    for (i = 0; i < arcade->n_sessions; ++i) {
+      key = benchmark_keys[(tick + i) % N_ELEMENTS(benchmark_keys)];
+      if (0 != key && arcade->sessions[i].active) {
+        if (-1 == write(arcade->sessions[i].master_fd, &key, 1)) {
+          emit_log(&arcade->error_logger, "Failed to send the key: errno=%d",
+                   errno);
+        }
+      }
+    }
+    if (!dispatch_arcade_events(arcade, 0)) {
+      break;
+    }
+    tick_arcade(arcade, 1L);
+  }
+  printf("wall_msec=%.3f process_cpu_msec=%.3f\n",
+         (get_clock_nsec(CLOCK_MONOTONIC) - wall_start_nsec) / 1e6,
+         (get_clock_nsec(CLOCK_PROCESS_CPUTIME_ID) - cpu_start_nsec) / 1e6);
+  report_arcade(arcade, stdout);
+  status = 0;
+
+ cleanup:
+  close_arcade(arcade);
+  free(slave_paths);
+  return status;
+}
@@ -0,0 +1,24 @@
+/*
+ * arcade.h
+ */
+
+#ifndef ARCADE_H_
+#define ARCADE_H_
+
+/**
+ * Host a game on each of the given terminals in this single process.
+ * The player hands the terminal over by leaving it idle (e.g. `sleep 1d`).
+ *
+ *   invaders --arcade /dev/pts/3 /dev/pts/5 ...
+ */
+extern int run_arcade(int argc, char **argv);
+
+/**
+ * Drive the given number of sessions on internal pseudo-terminals without
+ * the frame pacing, and report how many sessions one core sustains.
+ *
+ *   invaders --arcade-bench <n_sessions> [n_ticks]
+ */
+extern int run_arcade_benchmark(int argc, char **argv);
+
+#endif /* ARCADE_H_ */
@@ -0,0 +1,78 @@
+/*
+ * behaviour.c
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "behaviour.h"
+
+static void update_next_wake_times(struct behaviour_scheduler *scheduler) {
+  int i;
+  const struct behaviour_script *script;
+
+  for (i = 0; i < N_BEHAVIOUR_CLOCKS; ++i) {
+    scheduler->next_wake_times[i] = INT32_MAX;
+  }
+  for (i = 0; i < scheduler->n_scripts; ++i) {
+    script = &scheduler->scripts[i];
+    if (scheduler->next_wake_times[script->clock] > script->wake_time) {
+      scheduler->next_wake_times[script->clock] = script->wake_time;
+    }
+  }
+}
+
+void reset_behaviour_scheduler(struct behaviour_scheduler *scheduler,
+                               int n_scripts) {
+  int i;
+
+  for (i = 0; i < N_BEHAVIOUR_CLOCKS; ++i) {
+    scheduler->clocks[i] = 0;
+  }
+  scheduler->n_scripts = n_scripts;
+  for (i = 0; i < n_scripts; ++i) {
+    scheduler->scripts[i].wake_time = INT32_MAX;
+    scheduler->scripts[i].resume_point = 0;
+    scheduler->scripts[i].clock = GAME_BEHAVIOUR_CLOCK;
+  }
+  update_next_wake_times(scheduler);
+}
+
+/**
+ * (Re)start the script from its beginning at the wake time on the clock
+ */
+void start_behaviour_script(struct behaviour_scheduler *scheduler, int index,
+                            enum behaviour_clock clock, int32_t wake_time) {
+  scheduler->scripts[index].wake_time = wake_time;
+  scheduler->scripts[index].resume_point = 0;
+  scheduler->scripts[index].clock = (uint8_t) clock;
+  update_next_wake_times(scheduler);
+}
+
+/**
+ * Advance the clocks and resume each due script once
+ */
+void run_behaviour_scripts(struct behaviour_scheduler *scheduler,
+                           const int32_t *elapsed_times,
+                           const behaviour_function *functions,
+                           void *context) {
+  int i;
+  bool due;
+  struct behaviour_script *script;
+
+  due = false;
+  for (i = 0; i < N_BEHAVIOUR_CLOCKS; ++i) {
+    scheduler->clocks[i] += elapsed_times[i];
+    due |= scheduler->clocks[i] >= scheduler->next_wake_times[i];
+  }
+  if (!due) {
+    return;
+  }
+  for (i = 0; i < scheduler->n_scripts; ++i) {
+    script = &scheduler->scripts[i];
+    if (scheduler->clocks[script->clock] >= script->wake_time) {
+      functions[i](script, scheduler->clocks[script->clock], context);
+    }
+  }
+  update_next_wake_times(scheduler);
+}
@@ -0,0 +1,71 @@
+/*
+ * behaviour.h
+ */
+
+#ifndef BEHAVIOUR_H_
+#define BEHAVIOUR_H_
+
+#include <stdint.h>
+
+#include "invaders_config.h"
+
+/*
+ * Stackless coroutines resumed by a scheduler once their wake time has come
+ * on their clock. A script is a function written between BEGIN_BEHAVIOUR and
+ * END_BEHAVIOUR, which yields with WAIT_BEHAVIOUR and resumes right after it;
+ * its locals do not survive a wait, so the state lives in the game. A script
+ * running off its end sleeps for good.
+ */
+#define BEGIN_BEHAVIOUR(_script) \
+  switch ((_script)->resume_point) { \
+    case 0:
+#define WAIT_BEHAVIOUR(_script, _wake_time) \
+  do { \
+    (_script)->wake_time = (_wake_time); \
+    (_script)->resume_point = __LINE__; \
+    return; \
+    case __LINE__:; \
+  } while (0)
+#define END_BEHAVIOUR(_script) \
+  } \
+  (_script)->wake_time = INT32_MAX
+
+enum behaviour_clock {
+  /* The time of the game, stopping on the events */
+  GAME_BEHAVIOUR_CLOCK = 0,
+  /* The time scaled by the aggression level of the invaders */
+  FORMATION_BEHAVIOUR_CLOCK,
+  N_BEHAVIOUR_CLOCKS,
+};
+
+struct behaviour_script {
+  int32_t wake_time;
+  uint16_t resume_point;
+  uint8_t clock;
+};
+
+/**
+ * Resumes a script only when due; the earliest wake time of each clock lets
+ * the steps with nothing due skip the scripts entirely
+ */
+struct behaviour_scheduler {
+  int32_t clocks[N_BEHAVIOUR_CLOCKS];
+  int32_t next_wake_times[N_BEHAVIOUR_CLOCKS];
+  int n_scripts;
+  struct behaviour_script scripts[MAX_BEHAVIOUR_SCRIPTS];
+};
+
+typedef void (*behaviour_function)(struct behaviour_script *script,
+                                   int32_t now, void *context);
+
+extern void reset_behaviour_scheduler(struct behaviour_scheduler *scheduler,
+                                      int n_scripts);
+extern void start_behaviour_script(struct behaviour_scheduler *scheduler,
+                                   int index, enum behaviour_clock clock,
+                                   int32_t wake_time);
+extern void run_behaviour_scripts(struct behaviour_scheduler *scheduler,
+                                  const int32_t *elapsed_times,
+                                  const behaviour_function *functions,
+                                  void *context);
+
+#endif /* BEHAVIOUR_H_ */
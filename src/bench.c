@@ -0,0 +1,452 @@
+/*
+ * bench.c
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ncurses.h>
+
+#include "bench.h"
+#include "game.h"
+#include "invaders_config.h"
+#include "metrics.h"
+#include "render.h"
+#include "rollback.h"
+#include "sprite.h"
+#include "utility.h"
+
+/**
+ * The throughput of one board, per second of the CPU time spent on it
+ */
+struct replay_result {
+  int size_x;
+  int size_y;
+  long n_ticks;
+  long n_frames;
+  long n_bytes;
+  long cpu_nsec;
+  double ticks_per_sec;
+  double frames_per_sec;
+  double bytes_per_frame;
+};
+
+struct replay_tile {
+  struct game_session session;
+  unsigned int key_state;
+  bool started;
+  bool finished;
+  WINDOW *window;
+};
+
+static struct replay_tile replay_tiles[REPLAY_BENCHMARK_MAX_SCALE
+                                       * REPLAY_BENCHMARK_MAX_SCALE];
+static struct rollback peer_rollbacks[MAX_PLAYERS];
+static struct game_session peer_sessions[MAX_PLAYERS];
+static struct game_session lockstep_session;
+
+/**
+ * Play as a restless player would, pressing a key every few ticks
+ */
+static int pick_replay_key(unsigned int *key_state) {
+  static const int keys[] = {
+    'a', 'd', 'w', ERR, ERR, ERR, ERR, ERR,
+    ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,
+  };
+
+  return keys[rand_r(key_state) % N_ELEMENTS(keys)];
+}
+
+/**
+ * Replay every game of the corpus on all the tiles at once, from the title
+ * until each tile is back on it
+ */
+static void replay_corpus(int n_tiles, const struct sprite_atlas *atlas,
+                          struct render_buffer *buffer,
+                          struct replay_result *result) {
+  static const unsigned int seeds[] = REPLAY_BENCHMARK_SEEDS;
+  int i, j, n_finished;
+  long tick, elapsed_msec, simulated_msec, frame_msec;
+  struct replay_tile *tile;
+
+  for (i = 0; i < N_ELEMENTS(seeds); ++i) {
+    for (j = 0; j < n_tiles; ++j) {
+      tile = &replay_tiles[j];
+      reset_game_session(&tile->session, seeds[i] + j, NULL);
+      tile->key_state = seeds[i] ^ (unsigned int) j;
+      tile->started = false;
+      tile->finished = false;
+    }
+    simulated_msec = 0L;
+    frame_msec = 0L;
+    n_finished = 0;
+    for (tick = 0L; REPLAY_BENCHMARK_MAX_TICKS > tick && n_tiles > n_finished;
+         ++tick) {
+      elapsed_msec = get_tick_elapsed_time(tick);
+      simulated_msec += elapsed_msec;
+      for (j = 0; j < n_tiles; ++j) {
+        tile = &replay_tiles[j];
+        if (tile->finished) {
+          continue;
+        }
+        update_game_session(&tile->session, pick_replay_key(&tile->key_state),
+                            elapsed_msec);
+        ++result->n_ticks;
+        if (INGAME_SCENE == tile->session.scene) {
+          tile->started = true;
+        } else if (tile->started) {
+          tile->finished = true;
+          ++n_finished;
+        }
+      }
+
+      /* Render on the frame clock of the interactive game */
+      if (frame_msec <= simulated_msec) {
+        frame_msec += RENDER_FRAME_TIME;
+        erase();
+        for (j = 0; j < n_tiles; ++j) {
+          draw_game_session(&replay_tiles[j].session, atlas, buffer);
+          flush_render_buffer(buffer, replay_tiles[j].window);
+        }
+        refresh();
+        ++result->n_frames;
+      }
+    }
+  }
+}
+
+/**
+ * Measure a board of scale x scale canvases on a screen writing to the sink,
+ * replaying the corpus over as many rounds as the largest board has tiles
+ * for each, so that the smaller boards are not timed on too little work
+ */
+static bool replay_board(int scale, FILE *sink, struct logger *error_logger,
+                         struct replay_result *result) {
+  int i, n_tiles, round;
+  long cpu_start_nsec, cpu_nsec, written_bytes;
+  SCREEN *screen;
+  struct sprite_atlas atlas;
+  struct render_buffer buffer;
+  struct metrics_shard meter;
+
+  memset(result, 0, sizeof(*result));
+  result->size_x = CANVAS_SIZE_X * scale;
+  result->size_y = CANVAS_SIZE_Y * scale;
+  screen = newterm(REPLAY_BENCHMARK_TERM, sink, sink);
+  if (NULL == screen) {
+    emit_log(error_logger, "Failed to set up the benchmark screen");
+    return false;
+  }
+  set_term(screen);
+  if (!setup_game_screen(stdscr, error_logger)
+      || ERR == resizeterm(result->size_x, result->size_y)) {
+    endwin();
+    delscreen(screen);
+    return false;
+  }
+  compose_sprite_atlas(&atlas);
+  reset_render_buffer(&buffer);
+  n_tiles = scale * scale;
+  for (i = 0; i < n_tiles; ++i) {
+    replay_tiles[i].window = derwin(stdscr, CANVAS_SIZE_X, CANVAS_SIZE_Y,
+                                    (i / scale) * CANVAS_SIZE_X,
+                                    (i % scale) * CANVAS_SIZE_Y);
+  }
+
+  memset(&meter, 0, sizeof(meter));
+  open_output_meter(&meter);
+  written_bytes = read_output_meter(&meter);
+  cpu_start_nsec = get_clock_nsec(CLOCK_THREAD_CPUTIME_ID);
+  for (round = 0; round * n_tiles < REPLAY_BENCHMARK_MAX_SCALE
+       * REPLAY_BENCHMARK_MAX_SCALE; ++round) {
+    replay_corpus(n_tiles, &atlas, &buffer, result);
+  }
+  cpu_nsec = get_clock_nsec(CLOCK_THREAD_CPUTIME_ID) - cpu_start_nsec;
+  result->n_bytes = read_output_meter(&meter) - written_bytes;
+  close_output_meter(&meter);
+
+  for (i = 0; i < n_tiles; ++i) {
+    delwin(replay_tiles[i].window);
+  }
+  endwin();
+  delscreen(screen);
+  result->cpu_nsec = cpu_nsec;
+  result->ticks_per_sec = result->n_ticks * 1e9 / cpu_nsec;
+  result->frames_per_sec = result->n_frames * 1e9 / cpu_nsec;
+  result->bytes_per_frame = (0L < result->n_frames) ?
+      (double) result->n_bytes / result->n_frames : 0.0;
+  return true;
+}
+
+/**
+ * Keep the fastest of the repetitions of a board, as the noise only ever
+ * slows a run down; the counts and the bytes are the same on every one
+ */
+static void keep_fastest_replay_result(struct replay_result *fastest,
+                                       const struct replay_result *trial) {
+  if (0L == fastest->cpu_nsec || fastest->cpu_nsec > trial->cpu_nsec) {
+    *fastest = *trial;
+  }
+}
+
+static void write_replay_result(FILE *stream,
+                                const struct replay_result *result) {
+  fprintf(stream,
+          "board=%dx%d ticks_per_sec=%.1f frames_per_sec=%.1f "
+          "bytes_per_frame=%.1f\n",
+          result->size_x, result->size_y, result->ticks_per_sec,
+          result->frames_per_sec, result->bytes_per_frame);
+}
+
+/**
+ * Find the baseline of the board size, and return false when none
+ */
+static bool read_replay_baseline(FILE *file, int size_x, int size_y,
+                                 struct replay_result *baseline) {
+  char line[256];
+
+  rewind(file);
+  while (NULL != fgets(line, sizeof(line), file)) {
+    memset(baseline, 0, sizeof(*baseline));
+    if (5 == sscanf(line,
+                    "board=%dx%d ticks_per_sec=%lf frames_per_sec=%lf "
+                    "bytes_per_frame=%lf",
+                    &baseline->size_x, &baseline->size_y,
+                    &baseline->ticks_per_sec, &baseline->frames_per_sec,
+                    &baseline->bytes_per_frame)
+        && size_x == baseline->size_x && size_y == baseline->size_y) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Compare one rate against the baseline, where higher is better unless
+ * stated otherwise, and report it on a regression beyond the tolerance
+ */
+static bool compare_replay_rate(const struct replay_result *result,
+                                const char *name, double value,
+                                double baseline, bool lower_is_better) {
+  double change;
+
+  if (0.0 >= baseline) {
+    return true;
+  }
+  change = (value - baseline) / baseline;
+  if ((lower_is_better ? change : -change) <= REPLAY_BENCHMARK_TOLERANCE) {
+    return true;
+  }
+  fprintf(stderr, "REGRESSION: board=%dx%d %s=%.1f baseline=%.1f (%+.1f%%)\n",
+          result->size_x, result->size_y, name, value, baseline,
+          change * 100.0);
+  return false;
+}
+
+int run_replay_benchmark(int argc, char **argv) {
+  static const int scales[] = REPLAY_BENCHMARK_SCALES;
+  int i, j, status;
+  bool recording, passed;
+  const char *baseline_path;
+  FILE *sink, *baseline_file;
+  struct logger error_logger;
+  struct replay_result results[N_ELEMENTS(scales)], trial, baseline;
+
+  recording = (1 <= argc && 0 == strcmp(argv[0], "--record"));
+  if (recording) {
+    --argc;
+    ++argv;
+  }
+  baseline_path = (1 <= argc) ? argv[0] : REPLAY_BENCHMARK_BASELINE_FILEPATH;
+  sink = fopen("/dev/null", "r+");
+  if (NULL == sink) {
+    fprintf(stderr, "Failed to open the output sink\n");
+    return 1;
+  }
+  reset_logger(&error_logger, ERRORLOG_FILEPATH);
+  status = 1;
+  /* Take turns on the boards, so that a slow spell hits all of them alike */
+  memset(results, 0, sizeof(results));
+  for (j = 0; j < REPLAY_BENCHMARK_REPETITIONS; ++j) {
+    for (i = 0; i < N_ELEMENTS(scales); ++i) {
+      if (!replay_board(scales[i], sink, &error_logger, &trial)) {
+        fprintf(stderr, "Failed to replay on the board of scale %d\n",
+                scales[i]);
+        goto cleanup;
+      }
+      keep_fastest_replay_result(&results[i], &trial);
+    }
+  }
+  for (i = 0; i < N_ELEMENTS(scales); ++i) {
+    printf("board=%dx%d ticks=%ld frames=%ld fastest_of=%d ticks_per_sec=%.1f "
+           "frames_per_sec=%.1f bytes_per_frame=%.1f\n",
+           results[i].size_x, results[i].size_y, results[i].n_ticks,
+           results[i].n_frames, REPLAY_BENCHMARK_REPETITIONS,
+           results[i].ticks_per_sec, results[i].frames_per_sec,
+           results[i].bytes_per_frame);
+  }
+
+  /*
+   * Record the baseline on request or when there is none, which leaves
+   * nothing to compare against; only a comparison passes
+   */
+  fflush(stdout);
+  baseline_file = recording ? NULL : fopen(baseline_path, "r");
+  if (NULL == baseline_file) {
+    baseline_file = fopen(baseline_path, "w");
+    if (NULL == baseline_file) {
+      fprintf(stderr, "Failed to record the baseline: path=%s\n",
+              baseline_path);
+      goto cleanup;
+    }
+    for (i = 0; i < N_ELEMENTS(scales); ++i) {
+      write_replay_result(baseline_file, &results[i]);
+    }
+    fclose(baseline_file);
+    printf("RECORDED: baseline=%s, not compared\n", baseline_path);
+    status = recording ? 0 : 2;
+    goto cleanup;
+  }
+  passed = true;
+  for (i = 0; i < N_ELEMENTS(scales); ++i) {
+    if (!read_replay_baseline(baseline_file, results[i].size_x,
+                              results[i].size_y, &baseline)) {
+      fprintf(stderr, "No baseline for the board: board=%dx%d\n",
+              results[i].size_x, results[i].size_y);
+      passed = false;
+      continue;
+    }
+    passed &= compare_replay_rate(&results[i], "ticks_per_sec",
+                                  results[i].ticks_per_sec,
+                                  baseline.ticks_per_sec, false);
+    passed &= compare_replay_rate(&results[i], "frames_per_sec",
+                                  results[i].frames_per_sec,
+                                  baseline.frames_per_sec, false);
+    passed &= compare_replay_rate(&results[i], "bytes_per_frame",
+                                  results[i].bytes_per_frame,
+                                  baseline.bytes_per_frame, true);
+  }
+  fclose(baseline_file);
+  printf("%s: baseline=%s tolerance=%.0f%%\n", passed ? "PASSED" : "FAILED",
+         baseline_path, REPLAY_BENCHMARK_TOLERANCE * 100.0);
+  status = passed ? 0 : 1;
+
+ cleanup:
+  fclose(sink);
+  close_logger(&error_logger);
+  return status;
+}
+
+/**
+ * Check both peers against the lockstep simulation on the tick whose keys
+ * have just reached both of them
+ */
+static bool check_peer_checksums(int32_t tick, uint32_t lockstep_checksum) {
+  int i;
+  uint32_t checksum;
+
+  for (i = 0; i < MAX_PLAYERS; ++i) {
+    if (!get_rollback_checksum(&peer_rollbacks[i], tick, &checksum)) {
+      fprintf(stderr, "DESYNC: tick=%ld player=%d has no checksum\n",
+              (long) tick, i);
+      return false;
+    }
+    if (lockstep_checksum != checksum) {
+      fprintf(stderr, "DESYNC: tick=%ld player=%d checksum=%08x "
+              "lockstep=%08x\n", (long) tick, i, checksum, lockstep_checksum);
+      return false;
+    }
+  }
+  return true;
+}
+
+int run_rollback_benchmark(int argc, char **argv) {
+  static const unsigned int seeds[] = REPLAY_BENCHMARK_SEEDS;
+  int i, latency, keys[MAX_PLAYERS], sent_keys[ROLLBACK_WINDOW][MAX_PLAYERS];
+  int32_t tick;
+  long n_ticks, cpu_start_nsec, cpu_nsec, n_rollbacks, n_resimulated_ticks;
+  long total_rollback_nsec, max_rollback_nsec;
+  int max_rollback_ticks;
+  unsigned int key_states[MAX_PLAYERS];
+  uint32_t lockstep_checksums[ROLLBACK_WINDOW];
+  bool synced;
+
+  n_ticks = (1 <= argc) ? atol(argv[0]) : ROLLBACK_BENCHMARK_TICKS;
+  latency = (2 <= argc) ? atoi(argv[1]) : ROLLBACK_BENCHMARK_LATENCY;
+  if (0L >= n_ticks || 0 > latency || ROLLBACK_WINDOW - 1 <= latency) {
+    fprintf(stderr, "usage: invaders --rollback-bench [n_ticks] "
+            "[latency_ticks < %d]\n", ROLLBACK_WINDOW - 1);
+    return 2;
+  }
+  for (i = 0; i < MAX_PLAYERS; ++i) {
+    reset_game_session(&peer_sessions[i], seeds[0], NULL);
+    peer_sessions[i].n_players = MAX_PLAYERS;
+    reset_rollback(&peer_rollbacks[i], i);
+    key_states[i] = seeds[0] ^ (unsigned int) i;
+  }
+  reset_game_session(&lockstep_session, seeds[0], NULL);
+  lockstep_session.n_players = MAX_PLAYERS;
+
+  /* Each peer hears of the keys of the other the latency later */
+  synced = true;
+  cpu_start_nsec = get_clock_nsec(CLOCK_THREAD_CPUTIME_ID);
+  for (tick = 0; n_ticks > tick && synced; ++tick) {
+    for (i = 0; i < MAX_PLAYERS; ++i) {
+      keys[i] = pick_replay_key(&key_states[i]);
+      sent_keys[tick % ROLLBACK_WINDOW][i] = keys[i];
+    }
+    if (latency <= tick) {
+      for (i = 0; i < MAX_PLAYERS; ++i) {
+        confirm_remote_key(&peer_rollbacks[i], tick - latency,
+                           sent_keys[(tick - latency) % ROLLBACK_WINDOW]
+                                    [1 - i]);
+      }
+    }
+    for (i = 0; i < MAX_PLAYERS; ++i) {
+      advance_rollback(&peer_rollbacks[i], &peer_sessions[i], keys[i]);
+    }
+    update_game_session_with_keys(&lockstep_session, keys,
+                                  get_tick_elapsed_time(tick));
+    lockstep_checksums[tick % ROLLBACK_WINDOW] =
+        get_session_checksum(&lockstep_session);
+    if (latency <= tick) {
+      synced = check_peer_checksums(
+          tick - latency,
+          lockstep_checksums[(tick - latency) % ROLLBACK_WINDOW]);
+    }
+  }
+  cpu_nsec = get_clock_nsec(CLOCK_THREAD_CPUTIME_ID) - cpu_start_nsec;
+
+  n_rollbacks = 0L;
+  n_resimulated_ticks = 0L;
+  max_rollback_ticks = 0;
+  total_rollback_nsec = 0L;
+  max_rollback_nsec = 0L;
+  for (i = 0; i < MAX_PLAYERS; ++i) {
+    n_rollbacks += peer_rollbacks[i].n_rollbacks;
+    n_resimulated_ticks += peer_rollbacks[i].n_resimulated_ticks;
+    total_rollback_nsec += peer_rollbacks[i].total_rollback_nsec;
+    if (max_rollback_ticks < peer_rollbacks[i].max_rollback_ticks) {
+      max_rollback_ticks = peer_rollbacks[i].max_rollback_ticks;
+    }
+    if (max_rollback_nsec < peer_rollbacks[i].max_rollback_nsec) {
+      max_rollback_nsec = peer_rollbacks[i].max_rollback_nsec;
+    }
+  }
+  printf("ticks=%ld latency_ticks=%d rollbacks=%ld resimulated_ticks=%ld "
+         "max_rollback_ticks=%d mean_rollback_usec=%.1f "
+         "max_rollback_usec=%.1f frame_budget_usec=%ld ticks_per_sec=%.0f\n",
+         (long) tick, latency, n_rollbacks, n_resimulated_ticks,
+         max_rollback_ticks,
+         (0L < n_rollbacks) ? total_rollback_nsec / 1e3 / n_rollbacks : 0.0,
+         max_rollback_nsec / 1e3,
+         RENDER_FRAME_TIME * 1000L,
+         (MAX_PLAYERS * (double) tick + n_resimulated_ticks + tick) * 1e9
+             / cpu_nsec);
+  printf("%s: peers against the lockstep simulation\n",
+         synced ? "PASSED" : "FAILED");
+  return synced ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+/*
+ * bench.h
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+/**
+ * Replay a fixed corpus of games through the simulation, the rendering and
+ * the terminal output into /dev/null on boards of growing size, and compare
+ * the best throughput of a few repetitions against the baseline, failing on
+ * a regression. The baseline is recorded instead on request, or when it does
+ * not exist yet, which exits with 2 as nothing was compared.
+ *
+ *   invaders --replay-bench [--record] [baseline_path]
+ */
+extern int run_replay_benchmark(int argc, char **argv);
+
+/**
+ * Play a two-player game on two rollback peers hearing of each other's keys
+ * the given ticks late, check both against a lockstep simulation knowing
+ * all the keys on time, and report the cost of the rollbacks.
+ *
+ *   invaders --rollback-bench [n_ticks] [latency_ticks]
+ */
+extern int run_rollback_benchmark(int argc, char **argv);
+
+#endif /* BENCH_H_ */
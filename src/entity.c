@@ -0,0 +1,213 @@
+/*
+ * entity.c
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "entity.h"
+
+/* Fail to compile when the ids or the due mask run out of bits */
+typedef char entity_id_check[(MAX_ENTITIES < NO_ENTITY) ? 1 : -1];
+typedef char moving_entity_check[(64 >= MAX_MOVING_ENTITIES) ? 1 : -1];
+
+void reset_entity_store(struct entity_store *store) {
+  memset(store, 0, sizeof(*store));
+  memset(store->collision_layers, NO_COLLISION_LAYER,
+         sizeof(store->collision_layers));
+}
+
+/**
+ * Count the moving timers of the living movers, and return the mask of the
+ * ones due to move
+ */
+uint64_t count_moving_timers(struct entity_store *store, long elapsed_time) {
+  int i;
+  uint64_t due_entities;
+
+  due_entities = 0U;
+  for (i = 0; i < MAX_MOVING_ENTITIES; ++i) {
+    if (store->alive[i]
+        && count_timer(&store->moving_timers[i], elapsed_time)) {
+      due_entities |= UINT64_C(1) << i;
+    }
+  }
+  return due_entities;
+}
+
+/**
+ * Move the due entities by their velocity, and retire the ones which would
+ * leave the range instead
+ */
+void move_entities(struct entity_store *store, uint64_t due_entities,
+                   const struct vector2 *range_min,
+                   const struct vector2 *range_max) {
+  int i, x, y;
+
+  while (0U != due_entities) {
+    i = __builtin_ctzll(due_entities);
+    due_entities &= due_entities - 1;
+    x = store->positions[i].x + store->velocities[i].x;
+    y = store->positions[i].y + store->velocities[i].y;
+    if (range_min->x > x || range_max->x < x
+        || range_min->y > y || range_max->y < y) {
+      store->alive[i] = false;
+    } else {
+      store->positions[i].x = x;
+      store->positions[i].y = y;
+    }
+  }
+}
+
+static void paint_cell(struct collision_grid *grid, int layer, int x, int y,
+                       entity_id id) {
+  if (0 <= x && COLLISION_GRID_SIZE_X > x && 0 <= y
+      && COLLISION_GRID_SIZE_Y > y) {
+    grid->cells[layer][x][y] = id;
+  }
+}
+
+static void paint_entity(struct collision_grid *grid,
+                         const struct entity_store *store, entity_id id) {
+  int x, y, block, layer;
+  uint64_t standings;
+  const struct vector2 *position, *size;
+
+  layer = store->collision_layers[id];
+  position = &store->positions[id];
+  size = &store->sizes[id];
+  if (FIRST_BLOCK_ENTITY <= id) {
+    standings = store->block_standings[id - FIRST_BLOCK_ENTITY];
+    while (0U != standings) {
+      block = __builtin_ctzll(standings);
+      standings &= standings - 1;
+      paint_cell(grid, layer, position->x + block % size->x,
+                 position->y + block / size->x, id);
+    }
+  } else {
+    for (x = position->x; x < position->x + size->x; ++x) {
+      for (y = position->y; y < position->y + size->y; ++y) {
+        paint_cell(grid, layer, x, y, id);
+      }
+    }
+  }
+}
+
+void build_collision_grid(struct collision_grid *grid,
+                          const struct entity_store *store) {
+  int i;
+
+  memset(grid->cells, NO_ENTITY, sizeof(grid->cells));
+  for (i = 0; i < MAX_ENTITIES; ++i) {
+    if (store->alive[i] && NO_COLLISION_LAYER != store->collision_layers[i]) {
+      paint_entity(grid, store, (entity_id) i);
+    }
+  }
+}
+
+entity_id find_collided_entity(const struct collision_grid *grid, int layer,
+                               const struct vector2 *point) {
+  if (0 > point->x || COLLISION_GRID_SIZE_X <= point->x || 0 > point->y
+      || COLLISION_GRID_SIZE_Y <= point->y) {
+    return NO_ENTITY;
+  }
+  return grid->cells[layer][point->x][point->y];
+}
+
+/**
+ * Kill the entity, and take it off the grid if any
+ */
+void remove_entity(struct entity_store *store, struct collision_grid *grid,
+                   entity_id id) {
+  int x, y, layer;
+  const struct vector2 *position, *size;
+
+  store->alive[id] = false;
+  layer = store->collision_layers[id];
+  if (NULL == grid || NO_COLLISION_LAYER == layer) {
+    return;
+  }
+  position = &store->positions[id];
+  size = &store->sizes[id];
+  for (x = position->x; x < position->x + size->x; ++x) {
+    for (y = position->y; y < position->y + size->y; ++y) {
+      if (0 <= x && COLLISION_GRID_SIZE_X > x && 0 <= y
+          && COLLISION_GRID_SIZE_Y > y && id == grid->cells[layer][x][y]) {
+        grid->cells[layer][x][y] = NO_ENTITY;
+      }
+    }
+  }
+}
+
+/**
+ * Knock the block at the point out of the entity, and off the grid if any
+ */
+void remove_entity_block(struct entity_store *store,
+                         struct collision_grid *grid, entity_id id,
+                         const struct vector2 *point) {
+  int block;
+  const struct vector2 *position;
+
+  position = &store->positions[id];
+  block = (point->y - position->y) * store->sizes[id].x
+      + (point->x - position->x);
+  store->block_standings[id - FIRST_BLOCK_ENTITY] &= ~(UINT64_C(1) << block);
+  if (NULL != grid && NO_COLLISION_LAYER != store->collision_layers[id]
+      && id == find_collided_entity(grid, store->collision_layers[id],
+                                    point)) {
+    grid->cells[store->collision_layers[id]][point->x][point->y] = NO_ENTITY;
+  }
+}
+
+/**
+ * Render the standing blocks of the entity with a blit per contiguous run
+ */
+static void draw_entity_blocks(const struct entity_store *store, entity_id id,
+                               const struct sprite *sprite,
+                               struct render_buffer *buffer) {
+  int x, y, run_head;
+  uint64_t standings;
+  chtype cell;
+  const struct vector2 *position, *size;
+
+  cell = sprite->rows[0].cells[0];
+  position = &store->positions[id];
+  size = &store->sizes[id];
+  standings = store->block_standings[id - FIRST_BLOCK_ENTITY];
+  for (x = 0; x < size->x; ++x) {
+    run_head = -1;
+    for (y = 0; y <= size->y; ++y) {
+      if (y < size->y
+          && 0U != (standings & (UINT64_C(1) << (y * size->x + x)))) {
+        if (0 > run_head) {
+          run_head = y;
+        }
+      } else if (0 <= run_head) {
+        push_cell_run_command(buffer, ENTITY_RENDER_LAYER, cell,
+                              position->x + x, position->y + run_head,
+                              y - run_head, false);
+        run_head = -1;
+      }
+    }
+  }
+}
+
+void draw_entities(const struct entity_store *store,
+                   const struct sprite_atlas *atlas,
+                   struct render_buffer *buffer) {
+  int i;
+  const struct sprite *sprite;
+
+  for (i = 0; i < MAX_ENTITIES; ++i) {
+    if (store->alive[i]) {
+      sprite = &atlas->sprites[store->sprites[i]];
+      if (FIRST_BLOCK_ENTITY <= i) {
+        draw_entity_blocks(store, (entity_id) i, sprite, buffer);
+      } else {
+        push_sprite_command(buffer, sprite, store->positions[i].x,
+                            store->positions[i].y);
+      }
+    }
+  }
+}
@@ -0,0 +1,74 @@
+/*
+ * entity.h
+ */
+
+#ifndef ENTITY_H_
+#define ENTITY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "invaders_config.h"
+#include "render.h"
+#include "sprite.h"
+#include "utility.h"
+
+/*
+ * A game object is an entity: an id into the dense arrays of the components,
+ * which the systems sweep in a pass each. The entities moving on their own
+ * take the lowest ids and own the moving components; the ones built of
+ * blocks take the highest ids and own a block mask, whose bit
+ * (y * size.x + x) is set while the cell (x, y) in the entity stands.
+ */
+typedef uint8_t entity_id;
+
+#define NO_ENTITY ((entity_id) UINT8_MAX)
+#define NO_COLLISION_LAYER (UINT8_MAX)
+#define FIRST_BLOCK_ENTITY (MAX_ENTITIES - MAX_BLOCK_ENTITIES)
+
+/**
+ * The components of all the entities
+ */
+struct entity_store {
+  struct timer moving_timers[MAX_MOVING_ENTITIES];
+  struct vector2 velocities[MAX_MOVING_ENTITIES];
+  uint64_t block_standings[MAX_BLOCK_ENTITIES];
+  struct vector2 positions[MAX_ENTITIES];
+  struct vector2 sizes[MAX_ENTITIES];
+  uint8_t types[MAX_ENTITIES];
+  uint8_t sprites[MAX_ENTITIES];
+  uint8_t collision_layers[MAX_ENTITIES];
+  bool alive[MAX_ENTITIES];
+};
+
+/**
+ * The living entities of each collision layer painted cell by cell, the
+ * later ids over the earlier ones, so that a point finds what it hits in a
+ * lookup. It is built on a step and thrown away after it.
+ */
+struct collision_grid {
+  entity_id cells[N_COLLISION_LAYERS][COLLISION_GRID_SIZE_X]
+                 [COLLISION_GRID_SIZE_Y];
+};
+
+extern void reset_entity_store(struct entity_store *store);
+extern uint64_t count_moving_timers(struct entity_store *store,
+                                    long elapsed_time);
+extern void move_entities(struct entity_store *store, uint64_t due_entities,
+                          const struct vector2 *range_min,
+                          const struct vector2 *range_max);
+extern void build_collision_grid(struct collision_grid *grid,
+                                 const struct entity_store *store);
+extern entity_id find_collided_entity(const struct collision_grid *grid,
+                                      int layer,
+                                      const struct vector2 *point);
+extern void remove_entity(struct entity_store *store,
+                          struct collision_grid *grid, entity_id id);
+extern void remove_entity_block(struct entity_store *store,
+                                struct collision_grid *grid, entity_id id,
+                                const struct vector2 *point);
+extern void draw_entities(const struct entity_store *store,
+                          const struct sprite_atlas *atlas,
+                          struct render_buffer *buffer);
+
+#endif /* ENTITY_H_ */
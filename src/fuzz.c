@@ -0,0 +1,397 @@
+/*
+ * fuzz.c
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ncurses.h>
+
+#include "fuzz.h"
+#include "game.h"
+#include "invaders_config.h"
+#include "utility.h"
+
+struct fuzz_worker {
+  int id;
+  unsigned int seed;
+  long n_ticks;
+  long n_games;
+  long n_collision_checks;
+  bool failed;
+  char message[256];
+  pthread_t thread;
+};
+
+static bool fuzz_failed = false;
+
+static bool fail_fuzz(struct fuzz_worker *worker, const char *format, ...) {
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(worker->message, sizeof(worker->message), format, args);
+  va_end(args);
+  worker->failed = true;
+  __atomic_store_n(&fuzz_failed, true, __ATOMIC_RELAXED);
+  return false;
+}
+
+/**
+ * The plain statement of the rectangle collision, cell by cell, which the
+ * collision kernels must agree with
+ */
+static bool reference_detect_collided(struct vector2 *one_position,
+                                      struct vector2 *one_size,
+                                      struct vector2 *theother_position,
+                                      struct vector2 *theother_size) {
+  int x, y, one_size_x, one_size_y, theother_size_x, theother_size_y;
+
+  one_size_x = (NULL == one_size) ? 1 : one_size->x;
+  one_size_y = (NULL == one_size) ? 1 : one_size->y;
+  theother_size_x = (NULL == theother_size) ? 1 : theother_size->x;
+  theother_size_y = (NULL == theother_size) ? 1 : theother_size->y;
+  for (x = one_position->x; x < one_position->x + one_size_x; ++x) {
+    for (y = one_position->y; y < one_position->y + one_size_y; ++y) {
+      if (theother_position->x <= x
+          && x < theother_position->x + theother_size_x
+          && theother_position->y <= y
+          && y < theother_position->y + theother_size_y) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static bool compare_collision(struct fuzz_worker *worker,
+                              struct vector2 *one_position,
+                              struct vector2 *one_size,
+                              struct vector2 *theother_position,
+                              struct vector2 *theother_size) {
+  ++worker->n_collision_checks;
+  if (detect_collided(one_position, one_size, theother_position, theother_size)
+      != reference_detect_collided(one_position, one_size, theother_position,
+                                   theother_size)) {
+    return fail_fuzz(worker,
+                     "collision mismatch: (%d,%d)+(%d,%d) vs (%d,%d)+(%d,%d)",
+                     one_position->x, one_position->y,
+                     (NULL == one_size) ? 1 : one_size->x,
+                     (NULL == one_size) ? 1 : one_size->y,
+                     theother_position->x, theother_position->y,
+                     (NULL == theother_size) ? 1 : theother_size->x,
+                     (NULL == theother_size) ? 1 : theother_size->y);
+  }
+  return true;
+}
+
+/**
+ * Find what the point hits on the layer by a scan over the living entities
+ * and their standing blocks, the later ids over the earlier ones
+ */
+static entity_id reference_find_collided_entity(struct entity_store *store,
+                                                int layer,
+                                                struct vector2 *point) {
+  int i, block;
+  entity_id found;
+  struct vector2 block_position;
+
+  found = NO_ENTITY;
+  for (i = 0; i < MAX_ENTITIES; ++i) {
+    if (!store->alive[i] || layer != store->collision_layers[i]) {
+      continue;
+    }
+    if (FIRST_BLOCK_ENTITY > i) {
+      if (reference_detect_collided(point, NULL, &store->positions[i],
+                                    &store->sizes[i])) {
+        found = (entity_id) i;
+      }
+      continue;
+    }
+    for (block = 0; block < store->sizes[i].x * store->sizes[i].y; ++block) {
+      block_position.x = store->positions[i].x + block % store->sizes[i].x;
+      block_position.y = store->positions[i].y + block / store->sizes[i].x;
+      if (0U != (store->block_standings[i - FIRST_BLOCK_ENTITY]
+          & (UINT64_C(1) << block))
+          && reference_detect_collided(point, NULL, &block_position, NULL)) {
+        found = (entity_id) i;
+      }
+    }
+  }
+  return found;
+}
+
+/**
+ * Run the collision kernels against the reference on the pairs the game
+ * tests on a tick, on the grid lookups of the bullets, and on a few random
+ * rectangles
+ */
+static bool check_collisions(struct fuzz_worker *worker,
+                             struct invaders_game *game,
+                             unsigned int *random_state) {
+  int i, j;
+  entity_id found, expected;
+  struct vector2 positions[2], sizes[2];
+  struct entity_store *entities = &game->entities;
+  struct collision_grid grid;
+
+  for (i = FIRST_INVADER_ENTITY; i < FIRST_INVADER_ENTITY + N_INVADERS; ++i) {
+    if (!compare_collision(worker, &entities->positions[PLAYER_JET_ENTITY],
+                           &entities->sizes[PLAYER_JET_ENTITY],
+                           &entities->positions[i], &entities->sizes[i])) {
+      return false;
+    }
+  }
+  for (i = FIRST_INVADER_BULLET_ENTITY;
+       i < FIRST_INVADER_BULLET_ENTITY + N_INVADER_BULLETS; ++i) {
+    if (entities->alive[i]
+        && !compare_collision(worker, &entities->positions[i], NULL,
+                              &entities->positions[PLAYER_JET_ENTITY],
+                              &entities->sizes[PLAYER_JET_ENTITY])) {
+      return false;
+    }
+  }
+  build_collision_grid(&grid, entities);
+  for (i = 0; i < MAX_MOVING_ENTITIES; ++i) {
+    for (j = 0; j < N_COLLISION_LAYERS && entities->alive[i]; ++j) {
+      ++worker->n_collision_checks;
+      found = find_collided_entity(&grid, j, &entities->positions[i]);
+      expected = reference_find_collided_entity(entities, j,
+                                                &entities->positions[i]);
+      if (found != expected) {
+        return fail_fuzz(worker,
+                         "grid mismatch: (%d,%d) layer=%d found=%d "
+                         "expected=%d", entities->positions[i].x,
+                         entities->positions[i].y, j, found, expected);
+      }
+    }
+  }
+  for (i = 0; i < FUZZ_RANDOM_COLLISIONS_PER_TICK; ++i) {
+    for (j = 0; j < 2; ++j) {
+      positions[j].x = rand_r(random_state) % 16;
+      positions[j].y = rand_r(random_state) % 16;
+      sizes[j].x = 1 + rand_r(random_state) % 5;
+      sizes[j].y = 1 + rand_r(random_state) % 5;
+    }
+    if (!compare_collision(worker, &positions[0], &sizes[0], &positions[1],
+                           &sizes[1])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool check_in_canvas(struct fuzz_worker *worker, const char *name,
+                            const struct vector2 *position, int size_x,
+                            int size_y) {
+  if (1 > position->x || CANVAS_SIZE_X - 1 < position->x + size_x
+      || 1 > position->y || CANVAS_SIZE_Y - 1 < position->y + size_y) {
+    return fail_fuzz(worker, "%s out of the canvas: (%d,%d)", name,
+                     position->x, position->y);
+  }
+  return true;
+}
+
+/**
+ * Check the invariants of a game across a tick
+ */
+static bool check_game_invariants(struct fuzz_worker *worker,
+                                  const struct invaders_game *before,
+                                  const struct invaders_game *after) {
+  int i, n_living_invaders;
+  long killed_score, score_gain;
+  const struct entity_store *entities = &after->entities;
+
+  /* The entities stay in the canvas */
+  if (!check_in_canvas(worker, "player jet",
+                       &entities->positions[PLAYER_JET_ENTITY],
+                       entities->sizes[PLAYER_JET_ENTITY].x,
+                       entities->sizes[PLAYER_JET_ENTITY].y)) {
+    return false;
+  }
+  for (i = 0; i < MAX_MOVING_ENTITIES; ++i) {
+    if (entities->alive[i]
+        && !check_in_canvas(worker, "bullet", &entities->positions[i], 1, 1)) {
+      return false;
+    }
+  }
+  n_living_invaders = 0;
+  killed_score = 0L;
+  for (i = FIRST_INVADER_ENTITY; i < FIRST_INVADER_ENTITY + N_INVADERS; ++i) {
+    if (entities->alive[i]) {
+      ++n_living_invaders;
+      if (!check_in_canvas(worker, "invader", &entities->positions[i],
+                           entities->sizes[i].x, entities->sizes[i].y)) {
+        return false;
+      }
+    }
+
+    /* The dead invaders never come back nor get hit again */
+    if (!before->entities.alive[i] && entities->alive[i]) {
+      return fail_fuzz(worker, "invader %d revived", i - FIRST_INVADER_ENTITY);
+    }
+    if (before->entities.alive[i] && !entities->alive[i]) {
+      killed_score += get_invader_score(entities->types[i]);
+    }
+  }
+  if (entities->alive[COMMANDER_INVADER_ENTITY]
+      && !check_in_canvas(worker, "commander invader",
+                          &entities->positions[COMMANDER_INVADER_ENTITY],
+                          entities->sizes[COMMANDER_INVADER_ENTITY].x,
+                          entities->sizes[COMMANDER_INVADER_ENTITY].y)) {
+    return false;
+  }
+  score_gain = after->score - before->score;
+  if (killed_score != score_gain
+      && killed_score + COMMANDER_INVADER_SCORE != score_gain) {
+    return fail_fuzz(worker, "score gained %ld for the kills worth %ld",
+                     score_gain, killed_score);
+  }
+  for (i = 0; i < MAX_BLOCK_ENTITIES; ++i) {
+    if (0U != (entities->block_standings[i]
+        & ~before->entities.block_standings[i])) {
+      return fail_fuzz(worker, "tochca block restored: tochca=%d", i);
+    }
+  }
+
+  /* The credit and the event go one way */
+  if (0 > after->credit || before->credit < after->credit) {
+    return fail_fuzz(worker, "credit went from %d to %d", before->credit,
+                     after->credit);
+  }
+  if (GAME_EVENT_NONE != before->event && before->event != after->event) {
+    return fail_fuzz(worker, "event changed from %d to %d", before->event,
+                     after->event);
+  }
+  if (GAME_EVENT_NONE == after->event && 0 == n_living_invaders) {
+    return fail_fuzz(worker, "game goes on with no invaders to shoot");
+  }
+  if (GAME_CLEAR_EVENT == after->event && 0 < n_living_invaders) {
+    return fail_fuzz(worker, "game cleared with %d invaders",
+                     n_living_invaders);
+  }
+  if (GAME_EVENT_NONE == after->event && after->event_caption.displaying) {
+    return fail_fuzz(worker, "caption displayed with no event");
+  }
+  return true;
+}
+
+static int pick_fuzz_key(unsigned int *random_state) {
+  static const int keys[] = {
+    ERR, ERR, 'a', 'd', 'w', KEY_LEFT, KEY_RIGHT, KEY_UP, 'q',
+  };
+
+  return keys[rand_r(random_state) % N_ELEMENTS(keys)];
+}
+
+/**
+ * Mostly the ideal frame time, sometimes a short or a fast-forwarding one
+ */
+static long pick_fuzz_elapsed_time(unsigned int *random_state) {
+  switch (rand_r(random_state) % 8) {
+    case 0:
+      return 1L + rand_r(random_state) % IDEAL_FRAME_TIME;
+    case 1:
+      return 1L + rand_r(random_state) % FUZZ_MAX_ELAPSED_TIME;
+    default:
+      return IDEAL_FRAME_TIME;
+  }
+}
+
+static void *run_fuzz_worker(void *argument) {
+  struct fuzz_worker *worker = argument;
+  struct game_session session;
+  struct invaders_game before;
+  unsigned int random_state;
+  long tick;
+  bool checkable;
+
+  random_state = worker->seed;
+  memset(&before, 0, sizeof(before));
+  reset_game_session(&session, worker->seed, NULL);
+  for (tick = 0L; tick < worker->n_ticks; ++tick) {
+    if (0 == (tick & 0xfff)
+        && __atomic_load_n(&fuzz_failed, __ATOMIC_RELAXED)) {
+      break;
+    }
+
+    /* The tick is checked as long as it stays in a game */
+    checkable = INGAME_SCENE == session.scene
+        && INGAME_SCENE == session.next_scene;
+    if (checkable) {
+      memcpy(&before, &session.game, sizeof(before));
+    } else if (INGAME_SCENE == session.next_scene) {
+      ++worker->n_games;
+    }
+    update_game_session(&session, pick_fuzz_key(&random_state),
+                        pick_fuzz_elapsed_time(&random_state));
+    if (checkable
+        && (!check_game_invariants(worker, &before, &session.game)
+            || !check_collisions(worker, &session.game, &random_state))) {
+      break;
+    }
+  }
+  worker->n_ticks = tick;
+  return NULL;
+}
+
+int run_fuzz(int argc, char **argv) {
+  int i, n_threads, status;
+  long n_ticks, total_ticks, total_games, total_checks;
+  unsigned int seed;
+  double elapsed_sec;
+  struct timespec start_time, end_time;
+  struct fuzz_worker *workers;
+
+  n_ticks = (1 <= argc) ? atol(argv[0]) : FUZZ_DEFAULT_TICKS;
+  n_threads = (2 <= argc) ? atoi(argv[1]) : 1;
+  seed = (3 <= argc) ? (unsigned int) strtoul(argv[2], NULL, 0) :
+      (unsigned int) time(NULL);
+  if (0L >= n_ticks || 0 >= n_threads) {
+    fprintf(stderr,
+            "usage: invaders --fuzz [n_ticks_per_thread] [n_threads] [seed]\n");
+    return 2;
+  }
+  workers = calloc(n_threads, sizeof(*workers));
+  if (NULL == workers) {
+    return 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (i = 0; i < n_threads; ++i) {
+    workers[i].id = i;
+    workers[i].seed = seed + (unsigned int) i;
+    workers[i].n_ticks = n_ticks;
+    if (0 != pthread_create(&workers[i].thread, NULL, run_fuzz_worker,
+                            &workers[i])) {
+      n_threads = i;
+      break;
+    }
+  }
+  status = 0;
+  total_ticks = 0L;
+  total_games = 0L;
+  total_checks = 0L;
+  for (i = 0; i < n_threads; ++i) {
+    pthread_join(workers[i].thread, NULL);
+    total_ticks += workers[i].n_ticks;
+    total_games += workers[i].n_games;
+    total_checks += workers[i].n_collision_checks;
+    if (workers[i].failed) {
+      fprintf(stderr, "FAILED: seed=%u tick=%ld: %s\n", workers[i].seed,
+              workers[i].n_ticks, workers[i].message);
+      status = 1;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+  elapsed_sec = (end_time.tv_sec - start_time.tv_sec)
+      + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+  printf("threads=%d ticks=%ld games=%ld collision_checks=%ld "
+         "ticks_per_min=%.0f\n",
+         n_threads, total_ticks, total_games, total_checks,
+         total_ticks * 60.0 / elapsed_sec);
+  free(workers);
+  return status;
+}
@@ -0,0 +1,16 @@
+/*
+ * fuzz.h
+ */
+
+#ifndef FUZZ_H_
+#define FUZZ_H_
+
+/**
+ * Drive headless games with random keys and frame times on every thread,
+ * checking the invariants and the collision kernels after every tick.
+ *
+ *   invaders --fuzz [n_ticks_per_thread] [n_threads] [seed]
+ */
+extern int run_fuzz(int argc, char **argv);
+
+#endif /* FUZZ_H_ */
@@ -0,0 +1,838 @@
+/*
+ * game.c
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ncurses.h>
+
+#include "game.h"
+#include "metrics.h"
+#include "trace.h"
+
+/* Fail to compile when the packed game state outgrows its budget */
+typedef char invaders_game_size_check[
+    (sizeof(struct invaders_game) <= INVADERS_GAME_SIZE_TARGET) ? 1 : -1];
+
+/* Fail to compile when the entities do not fit the store as laid out */
+typedef char game_entity_layout_check[
+    (N_GAME_ENTITIES == MAX_ENTITIES
+     && FIRST_INVADER_BULLET_ENTITY + N_INVADER_BULLETS == MAX_MOVING_ENTITIES
+     && FIRST_TOCHCA_ENTITY == FIRST_BLOCK_ENTITY) ? 1 : -1];
+
+bool setup_game_screen(WINDOW *window, struct logger *error_logger) {
+  if (ERR == wresize(window, CANVAS_SIZE_X, CANVAS_SIZE_Y)) {
+    emit_log(error_logger,
+             "Failed to change the ncurses setting for window size");
+    return false;
+  }
+  if (ERR == keypad(window, true)) {
+    emit_log(error_logger,
+             "Failed to change the ncurses setting for key input receiving");
+    return false;
+  }
+  if (ERR == noecho()) {
+    emit_log(error_logger,
+             "Failed to change the ncurses setting for echoing setting");
+    return false;
+  }
+  curs_set(0);
+  wtimeout(window, 0);
+  if (has_colors() && can_change_color()) {
+    if (ERR == start_color()) {
+      emit_log(error_logger,
+               "Failed to change the ncurses setting to set up coloring");
+      return false;
+    }
+    if ((ERR == init_pair(PLAYER_JET_COLOR_PAIR, PLAYER_JET_COLOR, COLOR_BLACK))
+        || (ERR == init_pair(PLAYER_BULLET_COLOR_PAIR, PLAYER_BULLET_COLOR,
+        COLOR_BLACK))
+        || (ERR == init_pair(TOCHCA_COLOR_PAIR, TOCHCA_COLOR, COLOR_BLACK))
+        || (ERR == init_pair(COMMANDER_INVADER_COLOR_PAIR, COMMANDER_INVADER_COLOR,
+            COLOR_BLACK))
+        || (ERR == init_pair(SENIOR_INVADER_COLOR_PAIR, SENIOR_INVADER_COLOR,
+        COLOR_BLACK))
+        || (ERR == init_pair(YOUNG_INVADER_COLOR_PAIR, YOUNG_INVADER_COLOR,
+        COLOR_BLACK))
+        || (ERR == init_pair(LOOKIE_INVADER_COLOR_PAIR, LOOKIE_INVADER_COLOR,
+        COLOR_BLACK))
+        || (ERR == init_pair(INVADER_BULLET_COLOR_PAIR, INVADER_BULLET_COLOR,
+        COLOR_BLACK))
+        || (ERR == init_pair(TITLE_COLOR_PAIR, TITLE_COLOR, COLOR_BLACK))
+        || (ERR == init_pair(HIGH_SCORE_COLOR_PAIR, HIGH_SCORE_COLOR,
+        COLOR_BLACK))
+        || (ERR == init_pair(EVENT_CAPTION_COLOR_PAIR, EVENT_CAPTION_COLOR,
+        COLOR_BLACK))
+        || (ERR == init_pair(SCORE_COLOR_PAIR, SCORE_COLOR, COLOR_BLACK))
+        || (ERR == init_pair(CREDIT_COLOR_PAIR, CREDIT_COLOR, COLOR_BLACK))
+        || (ERR
+            == init_pair(CANVAS_FRAME_COLOR_PAIR, CANVAS_FRAME_COLOR, COLOR_BLACK))) {
+      emit_log(error_logger,
+               "Failed to change the ncurses setting to define color pair");
+      return false;
+    }
+  }
+  return true;
+}
+
+void update_game_on_title_scene(int key, int *scene_change) {
+  /* Interpret the key inputs */
+  switch (key) {
+    case 'a':
+    case KEY_LEFT:
+    case 'd':
+    case KEY_RIGHT:
+    case 'w':
+    case KEY_UP:
+      *scene_change = INGAME_SCENE;
+      break;
+  }
+}
+
+void draw_title_scene(struct score_store *score_store,
+                      struct render_buffer *buffer) {
+  int i, n_records;
+  struct game_record records[SCORE_STORE_TOP_N];
+
+  push_text_command(buffer, HUD_RENDER_LAYER, TITLE_COLOR_PAIR,
+                    TITLE_POSITION_X,
+                    TITLE_POSITION_Y - strlen(TITLE_TEXT) / 2, TITLE_TEXT);
+
+  /* Render the high scores straight from the mapped index */
+  n_records = read_top_scores(score_store, records, N_ELEMENTS(records));
+  for (i = 0; i < n_records; ++i) {
+    push_text_command(buffer, HUD_RENDER_LAYER, HIGH_SCORE_COLOR_PAIR,
+                      HIGH_SCORE_POSITION_X + i, HIGH_SCORE_POSITION_Y,
+                      "%d. %06ld %s", i + 1, (long) records[i].score,
+                      (GAME_CLEAR_EVENT == records[i].outcome) ?
+                          GAME_CLEAR_CAPTION_TEXT : GAME_OVER_CAPTION_TEXT);
+  }
+}
+
+/**
+ * Reset all environments of game
+ */
+void reset_game(struct invaders_game *game, unsigned int seed,
+                int n_players) {
+  static const int jet_positions_y[MAX_PLAYERS] = PLAYER_JET_START_POSITIONS_Y;
+  int i;
+  struct entity_store *entities = &game->entities;
+
+  game->seed = seed;
+  game->random_state = seed;
+  game->play_time = 0L;
+  game->pending_time = 0L;
+  game->event = GAME_EVENT_NONE;
+  game->event_caption.displaying = false;
+  reset_timer(&game->event_caption.timer, EVENT_CAPTION_DISPLAYING_TIME);
+  game->score = SCORE_INITIAL_VALUE;
+  game->credit = CREDIT_INITIAL_VALUE;
+  game->n_players = (uint8_t) n_players;
+  reset_entity_store(entities);
+  for (i = 0; i < MAX_PLAYERS; ++i) {
+    entities->alive[PLAYER_JET_ENTITY + i] = (i < n_players);
+    entities->sprites[PLAYER_JET_ENTITY + i] = PLAYER_JET_SPRITE;
+    entities->positions[PLAYER_JET_ENTITY + i].x = PLAYER_JET_POSITION_X;
+    entities->positions[PLAYER_JET_ENTITY + i].y = jet_positions_y[i];
+    entities->sizes[PLAYER_JET_ENTITY + i].x = PLAYER_JET_SIZE_X;
+    entities->sizes[PLAYER_JET_ENTITY + i].y = PLAYER_JET_SIZE_Y;
+    entities->types[PLAYER_BULLET_ENTITY + i] = PLAYER_BULLET;
+    entities->sprites[PLAYER_BULLET_ENTITY + i] = PLAYER_BULLET_SPRITE;
+    entities->sizes[PLAYER_BULLET_ENTITY + i].x = 1;
+    entities->sizes[PLAYER_BULLET_ENTITY + i].y = 1;
+    entities->velocities[PLAYER_BULLET_ENTITY + i].x = -1;
+    reset_timer(&entities->moving_timers[PLAYER_BULLET_ENTITY + i],
+                PLAYER_BULLET_MOVING_INTERVAL);
+  }
+  for (i = FIRST_TOCHCA_ENTITY; i < FIRST_TOCHCA_ENTITY + N_TOCHCAS; ++i) {
+    entities->alive[i] = true;
+    entities->sprites[i] = TOCHCA_BLOCK_SPRITE;
+    entities->collision_layers[i] = TOCHCA_COLLISION_LAYER;
+    entities->block_standings[i - FIRST_BLOCK_ENTITY] = ALL_TOCHCA_BLOCKS;
+    entities->positions[i].x = TOCHCA_POSITION_X;
+    entities->positions[i].y = TOCHCA_POSITION_Y
+        + TOCHCA_LAYOUT_INTERVAL_Y * (i - FIRST_TOCHCA_ENTITY);
+    entities->sizes[i].x = N_TOCHCA_BLOCKS_LAYOUT_X;
+    entities->sizes[i].y = N_TOCHCA_BLOCKS / N_TOCHCA_BLOCKS_LAYOUT_X;
+  }
+  for (i = 0; i < N_INVADERS; ++i) {
+    entities->types[FIRST_INVADER_ENTITY + i] =
+        (0 == i % N_INVADERS_LAYOUT_X) ? SENIOR_INVADER :
+        (2 >= i % N_INVADERS_LAYOUT_X) ? YOUNG_INVADER : LOOKIE_INVADER;
+    entities->sprites[FIRST_INVADER_ENTITY + i] =
+        (SENIOR_INVADER == entities->types[FIRST_INVADER_ENTITY + i]) ?
+        SENIOR_INVADER_SPRITE :
+        (YOUNG_INVADER == entities->types[FIRST_INVADER_ENTITY + i]) ?
+            YOUNG_INVADER_SPRITE : LOOKIE_INVADER_SPRITE;
+    entities->collision_layers[FIRST_INVADER_ENTITY + i] =
+        INVADER_COLLISION_LAYER;
+    entities->alive[FIRST_INVADER_ENTITY + i] = true;
+    entities->positions[FIRST_INVADER_ENTITY + i].x = INVADER_START_POSITION_X
+        + INVADER_LAYOUT_INTERVAL_X * (i % 5);
+    entities->positions[FIRST_INVADER_ENTITY + i].y = INVADER_START_POSITION_Y
+        + INVADER_LAYOUT_INTERVAL_Y * (i / 5);
+    entities->sizes[FIRST_INVADER_ENTITY + i].x = INVADER_SIZE_X;
+    entities->sizes[FIRST_INVADER_ENTITY + i].y = INVADER_SIZE_Y;
+  }
+  game->formation_speed_y = 1;
+  entities->types[COMMANDER_INVADER_ENTITY] = COMMANDER_INVADER;
+  entities->sprites[COMMANDER_INVADER_ENTITY] = COMMANDER_INVADER_SPRITE;
+  entities->collision_layers[COMMANDER_INVADER_ENTITY] =
+      INVADER_COLLISION_LAYER;
+  entities->positions[COMMANDER_INVADER_ENTITY].x =
+      COMMANDER_INVADER_START_POSITION_X;
+  entities->positions[COMMANDER_INVADER_ENTITY].y =
+      COMMANDER_INVADER_START_POSITION_Y;
+  entities->sizes[COMMANDER_INVADER_ENTITY].x = INVADER_SIZE_X;
+  entities->sizes[COMMANDER_INVADER_ENTITY].y = INVADER_SIZE_Y;
+  reset_timer(&game->shooting_timer, INVADER_SHOOTING_INTERVAL);
+  reset_behaviour_scheduler(&game->behaviour, N_INVADER_BEHAVIOURS);
+  start_behaviour_script(&game->behaviour, FORMATION_SWEEP_BEHAVIOUR,
+                         FORMATION_BEHAVIOUR_CLOCK, INVADER_MOVING_INTERVAL);
+  start_behaviour_script(&game->behaviour, COMMANDER_TURN_BEHAVIOUR,
+                         GAME_BEHAVIOUR_CLOCK, COMMANDER_INVADER_TURN_INTERVAL);
+  for (i = FIRST_INVADER_BULLET_ENTITY;
+       i < FIRST_INVADER_BULLET_ENTITY + N_INVADER_BULLETS; ++i) {
+    entities->types[i] = INVADER_BULLET;
+    entities->sprites[i] = INVADER_BULLET_SPRITE;
+    entities->sizes[i].x = 1;
+    entities->sizes[i].y = 1;
+    entities->velocities[i].x = 1;
+    reset_timer(&entities->moving_timers[i], INVADER_BULLET_MOVING_INTERVAL);
+  }
+}
+
+static void invoke_event(struct invaders_game *game, enum game_event event) {
+  game->event = event;
+  game->event_caption.displaying = true;
+  clear_timer(&game->event_caption.timer);
+}
+
+static void apply_game_key(struct invaders_game *game, int player, int key) {
+  entity_id jet = PLAYER_JET_ENTITY + player;
+  entity_id bullet = PLAYER_BULLET_ENTITY + player;
+  struct entity_store *entities = &game->entities;
+  struct vector2 *jet_position = &entities->positions[jet];
+
+  /* Interpret the key inputs */
+  switch (key) {
+    case 'a':
+    case KEY_LEFT:
+      if (1 < jet_position->y) {
+        --jet_position->y;
+      }
+      break;
+    case 'd':
+    case KEY_RIGHT:
+      if (CANVAS_SIZE_Y - 1
+          > jet_position->y + entities->sizes[jet].y) {
+        ++jet_position->y;
+      }
+      break;
+    case 'w':
+    case KEY_UP:
+      if (!entities->alive[bullet]) {
+        entities->alive[bullet] = true;
+        memcpy(&entities->positions[bullet], jet_position,
+               sizeof(entities->positions[bullet]));
+        ++entities->positions[bullet].y;
+        clear_timer(&entities->moving_timers[bullet]);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * Get the score an invader of the type is worth
+ */
+long get_invader_score(int type) {
+  return (COMMANDER_INVADER == type) ? COMMANDER_INVADER_SCORE :
+      (SENIOR_INVADER == type) ? SENIOR_INVADER_SCORE :
+      (YOUNG_INVADER == type) ? YOUNG_INVADER_SCORE : LOOKIE_INVADER_SCORE;
+}
+
+/**
+ * Detect the player bullets hit with a tochca block or an invader
+ */
+static void detect_player_bullet_hits(struct invaders_game *game,
+                                      struct collision_grid *grid) {
+  int i;
+  entity_id hit_with;
+  struct entity_store *entities = &game->entities;
+  const struct vector2 *position;
+
+  for (i = PLAYER_BULLET_ENTITY; i < PLAYER_BULLET_ENTITY + MAX_PLAYERS; ++i) {
+    if (!entities->alive[i]) {
+      continue;
+    }
+    position = &entities->positions[i];
+    hit_with = find_collided_entity(grid, TOCHCA_COLLISION_LAYER, position);
+    if (NO_ENTITY != hit_with) {
+      entities->alive[i] = false;
+      remove_entity_block(entities, grid, hit_with, position);
+      continue;
+    }
+    hit_with = find_collided_entity(grid, INVADER_COLLISION_LAYER, position);
+    if (NO_ENTITY != hit_with) {
+      entities->alive[i] = false;
+      remove_entity(entities, grid, hit_with);
+      game->score += get_invader_score(entities->types[hit_with]);
+    }
+  }
+}
+
+/**
+ * Get the living jet the rectangle runs into, or NO_ENTITY
+ */
+static entity_id find_collided_jet(struct entity_store *entities,
+                                   struct vector2 *position,
+                                   struct vector2 *size) {
+  int i;
+
+  for (i = PLAYER_JET_ENTITY; i < PLAYER_JET_ENTITY + MAX_PLAYERS; ++i) {
+    if (entities->alive[i]
+        && detect_collided(position, size, &entities->positions[i],
+                           &entities->sizes[i])) {
+      return (entity_id) i;
+    }
+  }
+  return NO_ENTITY;
+}
+
+/**
+ * Get the moving speed of the invaders, which rises as they are killed
+ */
+static int get_invader_move_speed(int n_living_invaders) {
+  if (LEVEL7_THRESHOLD >= n_living_invaders) {
+    return LEVEL7_MOVE_SPEED;
+  } else if (LEVEL6_THRESHOLD >= n_living_invaders) {
+    return LEVEL6_MOVE_SPEED;
+  } else if (LEVEL5_THRESHOLD >= n_living_invaders) {
+    return LEVEL5_MOVE_SPEED;
+  } else if (LEVEL4_THRESHOLD >= n_living_invaders) {
+    return LEVEL4_MOVE_SPEED;
+  } else if (LEVEL3_THRESHOLD >= n_living_invaders) {
+    return LEVEL3_MOVE_SPEED;
+  } else if (LEVEL2_THRESHOLD >= n_living_invaders) {
+    return LEVEL2_MOVE_SPEED;
+  } else if (LEVEL1_THRESHOLD >= n_living_invaders) {
+    return LEVEL1_MOVE_SPEED;
+  }
+  return LEVEL0_MOVE_SPEED;
+}
+
+static int count_living_invaders(const struct invaders_game *game) {
+  int i, n_living_invaders;
+
+  n_living_invaders = 0;
+  for (i = FIRST_INVADER_ENTITY; i < FIRST_INVADER_ENTITY + N_INVADERS; ++i) {
+    n_living_invaders += game->entities.alive[i];
+  }
+  return n_living_invaders;
+}
+
+int get_game_level_speed(const struct invaders_game *game) {
+  return get_invader_move_speed(count_living_invaders(game));
+}
+
+int count_active_bullets(const struct invaders_game *game) {
+  int i, n_active_bullets;
+
+  n_active_bullets = 0;
+  for (i = 0; i < MAX_MOVING_ENTITIES; ++i) {
+    n_active_bullets += game->entities.alive[i];
+  }
+  return n_active_bullets;
+}
+
+/**
+ * Sweep the formation sideways in lock step, and step it down with the
+ * direction reversed once any of the invaders has reached the edge
+ */
+static void run_formation_sweep(struct behaviour_script *script, int32_t now,
+                                void *context) {
+  struct invaders_game *game = context;
+  struct entity_store *entities = &game->entities;
+  bool stepable;
+  int i;
+
+  UNUSED(now);
+  BEGIN_BEHAVIOUR(script);
+  while (true) {
+    stepable = false;
+    for (i = FIRST_INVADER_ENTITY; i < FIRST_INVADER_ENTITY + N_INVADERS;
+         ++i) {
+      if (entities->alive[i]
+          && ((0 > game->formation_speed_y
+              && INVADER_MOVING_RANGE_Y_MIN >= entities->positions[i].y)
+              || (0 < game->formation_speed_y
+                  && INVADER_MOVING_RANGE_Y_MAX
+                      <= entities->positions[i].y))) {
+        stepable = true;
+        break;
+      }
+    }
+    for (i = FIRST_INVADER_ENTITY; i < FIRST_INVADER_ENTITY + N_INVADERS;
+         ++i) {
+      if (entities->alive[i]) {
+        if (stepable) {
+          entities->positions[i].x += INVADER_INVASION_STEP_X;
+        } else {
+          entities->positions[i].y += game->formation_speed_y;
+        }
+      }
+    }
+    if (stepable) {
+      game->formation_speed_y *= -1;
+    }
+    WAIT_BEHAVIOUR(script, script->wake_time + INVADER_MOVING_INTERVAL);
+  }
+  END_BEHAVIOUR(script);
+}
+
+/**
+ * Fly the commander across the top on schedule, and schedule the next turn
+ * once it has been shot down or has left
+ */
+static void run_commander_turn(struct behaviour_script *script, int32_t now,
+                               void *context) {
+  struct invaders_game *game = context;
+  struct entity_store *entities = &game->entities;
+  struct vector2 *position = &entities->positions[COMMANDER_INVADER_ENTITY];
+
+  BEGIN_BEHAVIOUR(script);
+  while (true) {
+    entities->alive[COMMANDER_INVADER_ENTITY] = true;
+    position->x = COMMANDER_INVADER_START_POSITION_X;
+    position->y = COMMANDER_INVADER_START_POSITION_Y;
+    while (entities->alive[COMMANDER_INVADER_ENTITY]
+        && INVADER_MOVING_RANGE_Y_MAX > position->y) {
+      WAIT_BEHAVIOUR(script,
+                     script->wake_time + COMMANDER_INVADER_MOVING_INTERVAL);
+      if (entities->alive[COMMANDER_INVADER_ENTITY]) {
+        ++position->y;
+      }
+    }
+
+    /* Stay on the edge for a step before leaving */
+    if (entities->alive[COMMANDER_INVADER_ENTITY]) {
+      WAIT_BEHAVIOUR(script, now + 1);
+      remove_entity(entities, NULL, COMMANDER_INVADER_ENTITY);
+    }
+    WAIT_BEHAVIOUR(script, now + COMMANDER_INVADER_TURN_INTERVAL);
+  }
+  END_BEHAVIOUR(script);
+}
+
+static const behaviour_function invader_behaviours[N_INVADER_BEHAVIOURS] = {
+  run_formation_sweep,
+  run_commander_turn,
+};
+
+/**
+ * Make the invader at the head of a random living line shoot a bullet
+ */
+static void shoot_invader_bullet(struct invaders_game *game,
+                                 const entity_id *line_heads,
+                                 int n_living_lines) {
+  int i;
+  entity_id shooter;
+  struct entity_store *entities = &game->entities;
+
+  assert(0 < n_living_lines);
+  shooter = line_heads[rand_r(&game->random_state) % n_living_lines];
+  for (i = FIRST_INVADER_BULLET_ENTITY;
+       i < FIRST_INVADER_BULLET_ENTITY + N_INVADER_BULLETS; ++i) {
+    if (!entities->alive[i]) {
+      entities->alive[i] = true;
+      entities->positions[i].x = entities->positions[shooter].x + 2;
+      entities->positions[i].y = entities->positions[shooter].y + 1;
+      clear_timer(&entities->moving_timers[i]);
+      break;
+    }
+  }
+}
+
+/**
+ * Get the living player bullet the invader bullet runs into, or NO_ENTITY
+ */
+static entity_id find_crossed_player_bullet(const struct entity_store *entities,
+                                            const struct vector2 *position) {
+  int i;
+
+  for (i = PLAYER_BULLET_ENTITY; i < PLAYER_BULLET_ENTITY + MAX_PLAYERS; ++i) {
+    if (entities->alive[i] && entities->positions[i].x <= position->x
+        && entities->positions[i].y == position->y) {
+      return (entity_id) i;
+    }
+  }
+  return NO_ENTITY;
+}
+
+/**
+ * Detect the invader bullets hit with a player jet, a player bullet or a
+ * tochca block
+ */
+static void detect_invader_bullet_hits(struct invaders_game *game,
+                                       struct collision_grid *grid) {
+  int i;
+  entity_id hit_with;
+  struct entity_store *entities = &game->entities;
+  struct vector2 *position;
+
+  for (i = FIRST_INVADER_BULLET_ENTITY;
+       i < FIRST_INVADER_BULLET_ENTITY + N_INVADER_BULLETS; ++i) {
+    if (!entities->alive[i]) {
+      continue;
+    }
+    position = &entities->positions[i];
+    if (NO_ENTITY != find_collided_jet(entities, position, NULL)) {
+      entities->alive[i] = false;
+      if (0 < game->credit) {
+        game->credit -= 1;
+      } else {
+        invoke_event(game, GAME_OVER_EVENT);
+      }
+    } else if (NO_ENTITY
+        != (hit_with = find_crossed_player_bullet(entities, position))) {
+      entities->alive[hit_with] = false;
+      entities->alive[i] = false;
+    } else {
+      hit_with = find_collided_entity(grid, TOCHCA_COLLISION_LAYER, position);
+      if (NO_ENTITY != hit_with) {
+        entities->alive[i] = false;
+        remove_entity_block(entities, grid, hit_with, position);
+      }
+    }
+  }
+}
+
+/**
+ * Knock out the tochca blocks under the living invaders, and tell whether
+ * any of them has run into a player jet
+ */
+static bool detect_invader_body_hits(struct invaders_game *game,
+                                     struct collision_grid *grid) {
+  int i;
+  bool jet_hit;
+  entity_id hit_with;
+  struct entity_store *entities = &game->entities;
+  struct vector2 cell;
+
+  jet_hit = false;
+  for (i = FIRST_INVADER_ENTITY; i < FIRST_INVADER_ENTITY + N_INVADERS; ++i) {
+    if (!entities->alive[i]) {
+      continue;
+    }
+    for (cell.x = entities->positions[i].x;
+         cell.x < entities->positions[i].x + entities->sizes[i].x; ++cell.x) {
+      for (cell.y = entities->positions[i].y;
+           cell.y < entities->positions[i].y + entities->sizes[i].y;
+           ++cell.y) {
+        hit_with = find_collided_entity(grid, TOCHCA_COLLISION_LAYER, &cell);
+        if (NO_ENTITY != hit_with) {
+          remove_entity_block(entities, grid, hit_with, &cell);
+        }
+      }
+    }
+    jet_hit = jet_hit
+        || NO_ENTITY != find_collided_jet(entities, &entities->positions[i],
+                                          &entities->sizes[i]);
+  }
+  return jet_hit;
+}
+
+/**
+ * Advance the in-game entities by a step no longer than SIMULATION_STEP_TIME,
+ * within which each moving timer fires once at most
+ */
+static void step_game(struct invaders_game *game, long elapsed_time) {
+  static const struct vector2 bullet_range_min = {
+    BULLET_MOVING_RANGE_X_MIN, BULLET_MOVING_RANGE_Y_MIN,
+  };
+  static const struct vector2 bullet_range_max = {
+    BULLET_MOVING_RANGE_X_MAX, BULLET_MOVING_RANGE_Y_MAX,
+  };
+  int i, j, n_living_invaders, invader_move_speed, n_living_lines;
+  int32_t elapsed_times[N_BEHAVIOUR_CLOCKS];
+  bool jet_hit;
+  entity_id line_head, line_heads[N_INVADERS_LAYOUT_Y];
+  struct entity_store *entities = &game->entities;
+  struct collision_grid grid;
+
+  /* Decide the current aggression level */
+  n_living_invaders = 0;
+  n_living_lines = 0;
+  for (i = 0; i < N_INVADERS_LAYOUT_Y; ++i) {
+    line_head = NO_ENTITY;
+    for (j = N_INVADERS_LAYOUT_X - 1; j >= 0; --j) {
+      if (entities->alive[FIRST_INVADER_ENTITY + i * N_INVADERS_LAYOUT_X
+                          + j]) {
+        ++n_living_invaders;
+        if (NO_ENTITY == line_head) {
+          line_head = FIRST_INVADER_ENTITY + i * N_INVADERS_LAYOUT_X + j;
+        }
+      }
+    }
+    if (NO_ENTITY != line_head) {
+      line_heads[n_living_lines] = line_head;
+      ++n_living_lines;
+    }
+  }
+  invader_move_speed = get_invader_move_speed(n_living_invaders);
+
+  /* Resume the invader behaviours that are due */
+  elapsed_times[GAME_BEHAVIOUR_CLOCK] = (int32_t) elapsed_time;
+  elapsed_times[FORMATION_BEHAVIOUR_CLOCK] =
+      (int32_t) (elapsed_time * invader_move_speed / 100);
+  run_behaviour_scripts(&game->behaviour, elapsed_times, invader_behaviours,
+                        game);
+
+  /* Detect the invaders stepping onto the player bullet */
+  build_collision_grid(&grid, entities);
+  detect_player_bullet_hits(game, &grid);
+
+  /* Make the invader to shoot his bullet */
+  if (count_timer(&game->shooting_timer, elapsed_time)) {
+    shoot_invader_bullet(game, line_heads, n_living_lines);
+  }
+
+  /* move bullets */
+  move_entities(entities, count_moving_timers(entities, elapsed_time),
+                &bullet_range_min, &bullet_range_max);
+
+  /* Detect the bullet hits */
+  detect_player_bullet_hits(game, &grid);
+  detect_invader_bullet_hits(game, &grid);
+
+  /* Detect invaders hit with tochcas and the player jet */
+  jet_hit = detect_invader_body_hits(game, &grid);
+
+  /* Check the annihilation */
+  if (0 == count_living_invaders(game)) {
+    invoke_event(game, GAME_CLEAR_EVENT);
+  }
+
+  /* Detect player jet hit with the invaders */
+  if (GAME_EVENT_NONE == game->event && jet_hit) {
+    invoke_event(game, GAME_OVER_EVENT);
+  }
+
+  /* Check the invasion */
+  if (GAME_EVENT_NONE == game->event) {
+    for (i = 0; i < n_living_lines; ++i) {
+      if (entities->alive[line_heads[i]]
+          && INVADER_INVASION_THRESHOLD_POSITION_X
+              <= entities->positions[line_heads[i]].x + 1) {
+        invoke_event(game, GAME_OVER_EVENT);
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * Integrate the elapsed time in the fixed steps, carrying the remainder over
+ * to the next call, so that the game goes the same whatever the frame time
+ */
+void update_game_on_ingame_scene(struct invaders_game *game, const int *keys,
+                                 long elapsed_time, int *scene_change) {
+  int i;
+
+  if (GAME_EVENT_NONE == game->event) {
+    for (i = 0; i < game->n_players; ++i) {
+      apply_game_key(game, i, keys[i]);
+    }
+    game->play_time += elapsed_time;
+  }
+  game->pending_time += elapsed_time;
+  while (SIMULATION_STEP_TIME <= game->pending_time) {
+    game->pending_time -= SIMULATION_STEP_TIME;
+    if (GAME_EVENT_NONE == game->event) {
+      step_game(game, SIMULATION_STEP_TIME);
+    }
+
+    /* Update the caption timer */
+    if (game->event_caption.displaying
+        && count_timer(&game->event_caption.timer, SIMULATION_STEP_TIME)) {
+      game->event_caption.displaying = false;
+      *scene_change = TITLE_SCENE;
+      break;
+    }
+  }
+}
+
+/**
+ * Compose all the sprites from their patterns once before the game loop
+ */
+void compose_sprite_atlas(struct sprite_atlas *atlas) {
+  static const char *const player_jet_pattern[] = PLAYER_JET_SPRITE_PATTERN;
+  static const char *const player_bullet_pattern[] =
+      PLAYER_BULLET_SPRITE_PATTERN;
+  static const char *const commander_invader_pattern[] =
+      COMMANDER_INVADER_SPRITE_PATTERN;
+  static const char *const senior_invader_pattern[] =
+      SENIOR_INVADER_SPRITE_PATTERN;
+  static const char *const young_invader_pattern[] =
+      YOUNG_INVADER_SPRITE_PATTERN;
+  static const char *const lookie_invader_pattern[] =
+      LOOKIE_INVADER_SPRITE_PATTERN;
+  static const char *const invader_bullet_pattern[] =
+      INVADER_BULLET_SPRITE_PATTERN;
+  static const char *const tochca_block_pattern[] = TOCHCA_BLOCK_SPRITE_PATTERN;
+
+  compose_sprite(&atlas->sprites[PLAYER_JET_SPRITE], player_jet_pattern,
+                 N_ELEMENTS(player_jet_pattern),
+                 COLOR_PAIR(PLAYER_JET_COLOR_PAIR));
+  compose_sprite(&atlas->sprites[PLAYER_BULLET_SPRITE], player_bullet_pattern,
+                 N_ELEMENTS(player_bullet_pattern),
+                 COLOR_PAIR(PLAYER_BULLET_COLOR_PAIR));
+  compose_sprite(&atlas->sprites[COMMANDER_INVADER_SPRITE],
+                 commander_invader_pattern,
+                 N_ELEMENTS(commander_invader_pattern),
+                 COLOR_PAIR(COMMANDER_INVADER_COLOR_PAIR));
+  compose_sprite(&atlas->sprites[SENIOR_INVADER_SPRITE],
+                 senior_invader_pattern, N_ELEMENTS(senior_invader_pattern),
+                 COLOR_PAIR(SENIOR_INVADER_COLOR_PAIR));
+  compose_sprite(&atlas->sprites[YOUNG_INVADER_SPRITE], young_invader_pattern,
+                 N_ELEMENTS(young_invader_pattern),
+                 COLOR_PAIR(YOUNG_INVADER_COLOR_PAIR));
+  compose_sprite(&atlas->sprites[LOOKIE_INVADER_SPRITE],
+                 lookie_invader_pattern, N_ELEMENTS(lookie_invader_pattern),
+                 COLOR_PAIR(LOOKIE_INVADER_COLOR_PAIR));
+  compose_sprite(&atlas->sprites[INVADER_BULLET_SPRITE],
+                 invader_bullet_pattern, N_ELEMENTS(invader_bullet_pattern),
+                 COLOR_PAIR(INVADER_BULLET_COLOR_PAIR));
+  compose_sprite(&atlas->sprites[TOCHCA_BLOCK_SPRITE], tochca_block_pattern,
+                 N_ELEMENTS(tochca_block_pattern),
+                 COLOR_PAIR(TOCHCA_COLOR_PAIR));
+}
+
+void draw_ingame_scene(struct invaders_game *game,
+                       const struct sprite_atlas *atlas,
+                       struct render_buffer *buffer) {
+  /* Render the entities */
+  draw_entities(&game->entities, atlas, buffer);
+
+  /* Render score HUD */
+  push_text_command(buffer, HUD_RENDER_LAYER, SCORE_COLOR_PAIR,
+                    SCORE_POSITION_X,
+                    SCORE_POSITION_Y - 11/* the length of "SCORE: %04ld" */,
+                    "SCORE: %04ld", (long) game->score);
+
+  /* Render credit HUD */
+  push_text_command(buffer, HUD_RENDER_LAYER, CREDIT_COLOR_PAIR,
+                    CREDIT_POSITION_X, CREDIT_POSITION_Y, "CREDIT: %d",
+                    game->credit);
+
+  /* Render caption HUD with blinking */
+  if (game->event_caption.displaying
+      && (EVENT_CAPTION_BLINKING_INTERVAL
+          <= game->event_caption.timer.counter % 1000L)) {
+    const char *caption_text =
+        (GAME_CLEAR_EVENT == game->event) ?
+        GAME_CLEAR_CAPTION_TEXT : GAME_OVER_CAPTION_TEXT;
+    push_text_command(buffer, HUD_RENDER_LAYER, EVENT_CAPTION_COLOR_PAIR,
+                      EVENT_CAPTION_POSITION_X,
+                      EVENT_CAPTION_POSITION_Y - strlen(caption_text) / 2,
+                      "%s", caption_text);
+  }
+}
+
+void draw_canvas_frame(struct render_buffer *buffer) {
+  chtype cell;
+
+  cell = CANVAS_FRAME_RENDERING_CHAR | COLOR_PAIR(CANVAS_FRAME_COLOR_PAIR);
+  push_cell_run_command(buffer, HUD_RENDER_LAYER, cell, 0, 0, CANVAS_SIZE_Y,
+                        false);
+  push_cell_run_command(buffer, HUD_RENDER_LAYER, cell, 1, 0,
+                        CANVAS_SIZE_X - 2, true);
+  push_cell_run_command(buffer, HUD_RENDER_LAYER, cell, 1, CANVAS_SIZE_Y - 1,
+                        CANVAS_SIZE_X - 2, true);
+  push_cell_run_command(buffer, HUD_RENDER_LAYER, cell, CANVAS_SIZE_X - 1, 0,
+                        CANVAS_SIZE_Y, false);
+}
+
+void reset_game_session(struct game_session *session, unsigned int seed,
+                        struct score_store *score_store) {
+  session->scene = -1;
+  session->next_scene = TITLE_SCENE;
+  session->next_seed = seed;
+  session->n_players = 1;
+  session->score_store = score_store;
+  session->trace_writer = NULL;
+  session->metrics = NULL;
+}
+
+static void record_game(struct game_session *session) {
+  struct game_record record;
+
+  memset(&record, 0, sizeof(record));
+  record.score = session->game.score;
+  record.finished_time = time(NULL);
+  record.duration = (int32_t) session->game.play_time;
+  record.seed = session->game.seed;
+  record.credit = (int16_t) session->game.credit;
+  record.outcome = (uint8_t) session->game.event;
+  append_game_record(session->score_store, &record);
+  if (GAME_CLEAR_EVENT == session->game.event) {
+    count_metric(session->metrics, GAME_CLEARS_METRIC, 1L);
+  } else if (GAME_OVER_EVENT == session->game.event) {
+    count_metric(session->metrics, GAME_OVERS_METRIC, 1L);
+  }
+}
+
+void update_game_session(struct game_session *session, int key,
+                         long elapsed_time) {
+  update_game_session_with_keys(session, &key, elapsed_time);
+}
+
+/**
+ * Change the scene if requested on the last frame and update the objects
+ * with a key of each player
+ */
+void update_game_session_with_keys(struct game_session *session,
+                                   const int *keys, long elapsed_time) {
+  int i;
+
+  /* Change the next scene if needed */
+  if (session->scene != session->next_scene) {
+    if (INGAME_SCENE == session->scene) {
+      record_game(session);
+    }
+    session->scene = session->next_scene;
+    if (INGAME_SCENE == session->scene) {
+      reset_game(&session->game, session->next_seed, session->n_players);
+      count_metric(session->metrics, GAMES_STARTED_METRIC, 1L);
+      session->next_seed = (unsigned int) rand_r(&session->next_seed);
+    }
+  }
+
+  /* Update the objects */
+  if (TITLE_SCENE == session->scene) {
+    for (i = 0; i < session->n_players; ++i) {
+      update_game_on_title_scene(keys[i], &session->next_scene);
+    }
+  } else if (INGAME_SCENE == session->scene) {
+    update_game_on_ingame_scene(&session->game, keys, elapsed_time,
+                                &session->next_scene);
+    trace_game(session->trace_writer, &session->game);
+  }
+  count_metric(session->metrics, TICKS_METRIC, 1L);
+}
+
+void draw_game_session(struct game_session *session,
+                       const struct sprite_atlas *atlas,
+                       struct render_buffer *buffer) {
+  if (TITLE_SCENE == session->scene) {
+    draw_title_scene(session->score_store, buffer);
+  } else if (INGAME_SCENE == session->scene) {
+    draw_ingame_scene(&session->game, atlas, buffer);
+  }
+  draw_canvas_frame(buffer);
+}
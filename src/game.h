@@ -0,0 +1,173 @@
+/*
+ * game.h
+ */
+
+#ifndef GAME_H_
+#define GAME_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ncurses.h>
+
+#include "behaviour.h"
+#include "entity.h"
+#include "invaders_config.h"
+#include "render.h"
+#include "score_store.h"
+#include "sprite.h"
+#include "utility.h"
+
+enum scene {
+  TITLE_SCENE = 0,
+  INGAME_SCENE,
+};
+
+enum game_event {
+  GAME_EVENT_NONE = 0,
+  GAME_CLEAR_EVENT,
+  GAME_OVER_EVENT,
+};
+
+enum color_pair {
+  _PADDING = 0,
+
+  /* in-game entities */
+  PLAYER_JET_COLOR_PAIR,
+  PLAYER_BULLET_COLOR_PAIR,
+  TOCHCA_COLOR_PAIR,
+  COMMANDER_INVADER_COLOR_PAIR,
+  SENIOR_INVADER_COLOR_PAIR,
+  YOUNG_INVADER_COLOR_PAIR,
+  LOOKIE_INVADER_COLOR_PAIR,
+  INVADER_BULLET_COLOR_PAIR,
+
+  /* HUD objects */
+  TITLE_COLOR_PAIR,
+  HIGH_SCORE_COLOR_PAIR,
+  EVENT_CAPTION_COLOR_PAIR,
+  SCORE_COLOR_PAIR,
+  CREDIT_COLOR_PAIR,
+  CANVAS_FRAME_COLOR_PAIR,
+};
+
+enum invader_type {
+  COMMANDER_INVADER,
+  SENIOR_INVADER,
+  YOUNG_INVADER,
+  LOOKIE_INVADER,
+};
+
+enum bullet_type {
+  PLAYER_BULLET,
+  INVADER_BULLET,
+};
+
+enum invader_behaviour {
+  FORMATION_SWEEP_BEHAVIOUR = 0,
+  COMMANDER_TURN_BEHAVIOUR,
+  N_INVADER_BEHAVIOURS,
+};
+
+enum collision_layer {
+  INVADER_COLLISION_LAYER = 0,
+  TOCHCA_COLLISION_LAYER,
+};
+
+/*
+ * The ids of the in-game entities: the bullets move on their own, and the
+ * tochcas are built of blocks. The player p owns the bullet
+ * PLAYER_BULLET_ENTITY + p and the jet PLAYER_JET_ENTITY + p.
+ */
+enum game_entity {
+  PLAYER_BULLET_ENTITY = 0,
+  FIRST_INVADER_BULLET_ENTITY = PLAYER_BULLET_ENTITY + MAX_PLAYERS,
+  PLAYER_JET_ENTITY = FIRST_INVADER_BULLET_ENTITY + N_INVADER_BULLETS,
+  COMMANDER_INVADER_ENTITY = PLAYER_JET_ENTITY + MAX_PLAYERS,
+  FIRST_INVADER_ENTITY,
+  FIRST_TOCHCA_ENTITY = FIRST_INVADER_ENTITY + N_INVADERS,
+  N_GAME_ENTITIES = FIRST_TOCHCA_ENTITY + N_TOCHCAS,
+};
+
+/*
+ * The game state is packed for the many copies of it: the coordinates fit in
+ * 16 bits, the timers in 32 bits, the enumerations in a byte and the tochca
+ * blocks in the bits of a word. The fields are grouped by when they are
+ * touched rather than by width; game.c checks the whole against
+ * INVADERS_GAME_SIZE_TARGET.
+ */
+#define TOCHCA_BLOCK_BIT(_block) (UINT64_C(1) << (_block))
+#define ALL_TOCHCA_BLOCKS (TOCHCA_BLOCK_BIT(N_TOCHCA_BLOCKS) - 1)
+
+struct event_caption {
+  struct timer timer;
+  bool displaying;
+};
+
+/**
+ * The fields read on every step come first, then the entities, and the ones
+ * touched only on events last. It holds no pointer, so a plain copy of it is a
+ * complete snapshot of the game.
+ */
+struct invaders_game {
+  int32_t pending_time;
+  int32_t play_time;
+  uint32_t random_state;
+  uint8_t event;
+  uint8_t n_players;
+  int8_t formation_speed_y;
+  struct timer shooting_timer;
+  struct behaviour_scheduler behaviour;
+  struct entity_store entities;
+  int32_t score;
+  int16_t credit;
+  uint32_t seed;
+  struct event_caption event_caption;
+};
+
+struct trace_writer;
+struct metrics_shard;
+
+/**
+ * A game with its scene transition, driven by one key input per player and
+ * frame
+ */
+struct game_session {
+  int scene;
+  int next_scene;
+  int n_players;
+  unsigned int next_seed;
+  struct score_store *score_store;
+  struct trace_writer *trace_writer;
+  struct metrics_shard *metrics;
+  struct invaders_game game;
+};
+
+extern bool setup_game_screen(WINDOW *window, struct logger *error_logger);
+extern void compose_sprite_atlas(struct sprite_atlas *atlas);
+extern void reset_game(struct invaders_game *game, unsigned int seed,
+                       int n_players);
+extern void update_game_on_title_scene(int key, int *scene_change);
+extern void update_game_on_ingame_scene(struct invaders_game *game,
+                                        const int *keys, long elapsed_time,
+                                        int *scene_change);
+extern long get_invader_score(int type);
+extern int get_game_level_speed(const struct invaders_game *game);
+extern int count_active_bullets(const struct invaders_game *game);
+extern void draw_title_scene(struct score_store *score_store,
+                             struct render_buffer *buffer);
+extern void draw_ingame_scene(struct invaders_game *game,
+                              const struct sprite_atlas *atlas,
+                              struct render_buffer *buffer);
+extern void draw_canvas_frame(struct render_buffer *buffer);
+extern void reset_game_session(struct game_session *session,
+                               unsigned int seed,
+                               struct score_store *score_store);
+extern void update_game_session(struct game_session *session, int key,
+                                long elapsed_time);
+extern void update_game_session_with_keys(struct game_session *session,
+                                          const int *keys, long elapsed_time);
+extern void draw_game_session(struct game_session *session,
+                              const struct sprite_atlas *atlas,
+                              struct render_buffer *buffer);
+
+#endif /* GAME_H_ */
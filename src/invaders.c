@@ -5,776 +5,361 @@
  *      Author: minagawa-sho
  */
 
-#include <sys/time.h>
-#include <assert.h>
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <string.h>
-#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 #include <ncurses.h>
 
+#include "arcade.h"
+#include "bench.h"
+#include "fuzz.h"
+#include "game.h"
 #include "invaders_config.h"
+#include "metrics.h"
+#include "render.h"
+#include "rollback.h"
+#include "score_store.h"
+#include "sprite.h"
+#include "trace.h"
 #include "utility.h"
+#include "versus.h"
 
-enum scene {
-  TITLE_SCENE = 0,
-  INGAME_SCENE,
-};
-
-enum game_event {
-  GAME_EVENT_NONE = 0,
-  GAME_CLEAR_EVENT,
-  GAME_OVER_EVENT,
-};
-
-enum color_pair {
-  _PADDING = 0,
-
-  /* in-game entities */
-  PLAYER_JET_COLOR_PAIR,
-  PLAYER_BULLET_COLOR_PAIR,
-  TOCHCA_COLOR_PAIR,
-  COMMANDER_INVADER_COLOR_PAIR,
-  SENIOR_INVADER_COLOR_PAIR,
-  YOUNG_INVADER_COLOR_PAIR,
-  LOOKIE_INVADER_COLOR_PAIR,
-  INVADER_BULLET_COLOR_PAIR,
-
-  /* HUD objects */
-  TITLE_COLOR_PAIR,
-  EVENT_CAPTION_COLOR_PAIR,
-  SCORE_COLOR_PAIR,
-  CREDIT_COLOR_PAIR,
-  CANVAS_FRAME_COLOR_PAIR,
-};
-
-enum invader_type {
-  COMMANDER_INVADER,
-  SENIOR_INVADER,
-  YOUNG_INVADER,
-  LOOKIE_INVADER,
-};
-
-enum bullet_type {
-  PLAYER_BULLET,
-  INVADER_BULLET,
-};
-
-struct event_caption {
-  bool displaying;
-  struct timer timer;
-};
-
-struct player_jet {
-  struct vector2 position;
-  struct vector2 size;
-};
-
-struct tochca {
-  bool block_standings[N_TOCHCA_BLOCKS];
-  struct vector2 position;
-};
-
-struct invader {
-  enum invader_type type;
-  bool alive;
-  struct vector2 position;
-  struct vector2 size;
-  struct timer moving_timer;
-  int moving_speed_y;
-};
-
-struct invader_team {
-  struct invader members[N_INVADERS];
-  struct invader commander;
-  struct timer shooting_timer;
-  struct timer commander_turn_timer;
+/**
+ * The state of one simulation tick, handed over to the render thread
+ */
+struct render_snapshot {
+  struct game_session session;
+  long tick;
 };
 
-struct bullet {
-  enum bullet_type type;
-  bool active;
-  struct vector2 position;
-  struct timer moving_timer;
+/**
+ * Shared by the simulation thread, which owns the session, and the render
+ * thread, which owns ncurses and sees the session only through snapshots.
+ * In the versus mode the simulation thread owns the link and the rollback.
+ */
+struct game_loop {
+  struct game_session session;
+  struct versus_link *versus_link;
+  struct rollback rollback;
+  struct render_snapshot snapshots[3];
+  struct triple_buffer snapshot_buffer;
+  struct key_queue key_queue;
+  struct key_queue applied_key_queue;
+  bool quitting;
+  long n_ticks;
+  long n_late_ticks;
+  long n_stalled_ticks;
 };
 
-struct invaders_game {
-  enum game_event event;
-  struct event_caption event_caption;
-  long score;
-  int credit;
-  struct player_jet player_jet;
-  struct bullet player_bullet;
-  struct tochca tochcas[N_TOCHCAS];
-  struct invader_team invader_team;
-  struct bullet invader_bullets[N_INVADER_BULLETS];
-};
+static volatile sig_atomic_t quit_requested = 0;
+static struct trace_writer trace_writer;
+static struct versus_link versus_link;
+static struct game_loop game_loop;
+static struct metrics metrics;
 
-static void update_game_on_title_scene(int *scene_change) {
-  /* Interpret the key inputs */
-  switch (getch()) {
-    case 'a':
-    case KEY_LEFT:
-    case 'd':
-    case KEY_RIGHT:
-    case 'w':
-    case KEY_UP:
-      *scene_change = INGAME_SCENE;
-      break;
-  }
+static void request_quit(int signum) {
+  UNUSED(signum);
+  quit_requested = 1;
 }
 
-static void draw_title_scene() {
-  attron(COLOR_PAIR(TITLE_COLOR_PAIR));
-  move(TITLE_POSITION_X, TITLE_POSITION_Y - strlen(TITLE_TEXT) / 2);
-  addstr(TITLE_TEXT);
+static void advance_deadline(struct timespec *deadline, long nsec) {
+  deadline->tv_nsec += nsec;
+  while (1000000000L <= deadline->tv_nsec) {
+    deadline->tv_nsec -= 1000000000L;
+    ++deadline->tv_sec;
+  }
 }
 
 /**
- * Reset all environments of game
+ * Get the milliseconds left until the deadline, rounded up, or zero
  */
-static void reset_game(struct invaders_game *game) {
-  int i, j;
+static long get_msec_until(const struct timespec *now,
+                           const struct timespec *deadline) {
+  long nsec;
 
-  game->event = GAME_EVENT_NONE;
-  game->event_caption.displaying = false;
-  reset_timer(&game->event_caption.timer, EVENT_CAPTION_DISPLAYING_TIME);
-  game->score = SCORE_INITIAL_VALUE;
-  game->credit = CREDIT_INITIAL_VALUE;
-  game->player_jet.position.x = PLAYER_JET_POSITION_X;
-  game->player_jet.position.y = PLAYER_JET_START_POSITION_Y;
-  game->player_jet.size.x = PLAYER_JET_SIZE_X;
-  game->player_jet.size.y = PLAYER_JET_SIZE_Y;
-  game->player_bullet.type = PLAYER_BULLET;
-  game->player_bullet.active = false;
-  reset_timer(&game->player_bullet.moving_timer, PLAYER_BULLET_MOVING_INTERVAL);
-  for (i = 0; i < N_ELEMENTS(game->tochcas); ++i) {
-    for (j = 0; j < N_ELEMENTS(game->tochcas[i].block_standings); ++j) {
-      game->tochcas[i].block_standings[j] = true;
-    }
-    game->tochcas[i].position.x = TOCHCA_POSITION_X;
-    game->tochcas[i].position.y = TOCHCA_POSITION_Y
-        + TOCHCA_LAYOUT_INTERVAL_Y * i;
-  }
-  for (i = 0; i < N_ELEMENTS(game->invader_team.members); ++i) {
-    game->invader_team.members[i].type =
-        (0 == i % N_INVADERS_LAYOUT_X) ? SENIOR_INVADER :
-        (2 >= i % N_INVADERS_LAYOUT_X) ? YOUNG_INVADER : LOOKIE_INVADER;
-    game->invader_team.members[i].alive = true;
-    game->invader_team.members[i].position.x = INVADER_START_POSITION_X
-        + INVADER_LAYOUT_INTERVAL_X * (i % 5);
-    game->invader_team.members[i].position.y = INVADER_START_POSITION_Y
-        + INVADER_LAYOUT_INTERVAL_Y * (i / 5);
-    game->invader_team.members[i].size.x = INVADER_SIZE_X;
-    game->invader_team.members[i].size.y = INVADER_SIZE_Y;
-    reset_timer(&game->invader_team.members[i].moving_timer,
-                INVADER_MOVING_INTERVAL);
-    game->invader_team.members[i].moving_speed_y = 1;
-  }
-  game->invader_team.commander.type = COMMANDER_INVADER;
-  game->invader_team.commander.alive = false;
-  game->invader_team.commander.position.x = COMMANDER_INVADER_START_POSITION_X;
-  game->invader_team.commander.position.y = COMMANDER_INVADER_START_POSITION_Y;
-  reset_timer(&game->invader_team.commander.moving_timer,
-              COMMANDER_INVADER_MOVING_INTERVAL);
-  game->invader_team.commander.moving_speed_y = 0;
-  reset_timer(&game->invader_team.shooting_timer, INVADER_SHOOTING_INTERVAL);
-  reset_timer(&game->invader_team.commander_turn_timer, COMMANDER_INVADER_TURN_INTERVAL);
-  for (i = 0; i < N_ELEMENTS(game->invader_bullets); ++i) {
-    game->invader_bullets[i].type = INVADER_BULLET;
-    game->invader_bullets[i].active = false;
-    reset_timer(&game->invader_bullets[i].moving_timer, INVADER_BULLET_MOVING_INTERVAL);
-  }
+  nsec = (deadline->tv_sec - now->tv_sec) * 1000000000L
+      + (deadline->tv_nsec - now->tv_nsec);
+  return (0L < nsec) ? (nsec + 999999L) / 1000000L : 0L;
 }
 
-static void move_bullet(struct bullet *bullet, long elapsed_time) {
-  if (bullet->active) {
-    if (count_timer(&bullet->moving_timer, elapsed_time)) {
-      if (2 >= bullet->position.x
-          || (CANVAS_SIZE_X - 3) <= bullet->position.x) {
-        bullet->active = false;
-      } else {
-        bullet->position.x += (PLAYER_BULLET == bullet->type) ? -1 : 1;
-      }
-    }
+/**
+ * Sleep until the next tick is due; catch up without sleeping when the tick
+ * itself overran
+ */
+static void wait_next_tick(struct game_loop *loop, struct timespec *deadline,
+                           long tick_nsec) {
+  struct timespec now;
+
+  advance_deadline(deadline, tick_nsec);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (0L == get_msec_until(&now, deadline)) {
+    ++loop->n_late_ticks;
+    return;
   }
-}
-
-static void get_tochca_block_position(struct tochca *tochca, int block,
-                                      struct vector2 *block_position) {
-   block_position->x = tochca->position.x + (block % N_TOCHCA_BLOCKS_LAYOUT_X);
-   block_position->y = tochca->position.y + (block / N_TOCHCA_BLOCKS_LAYOUT_X);
-}
-
-static struct tochca *detect_collieded_with_tochcas(struct vector2 *point,
-                                                    struct tochca *tochcas,
-                                                    size_t n_tochcas,
-                                                    int *block_hit_with) {
-  int i;
-  int j;
-  struct vector2 block_position;
-
-  for (i = 0; i < (int) n_tochcas; ++i) {
-    for (j = 0; j < N_ELEMENTS(tochcas[i].block_standings); ++j) {
-      if (tochcas[i].block_standings[j]) {
-        get_tochca_block_position(&tochcas[i], j, &block_position);
-        if (detect_collided(point, NULL, &block_position, NULL)) {
-          *block_hit_with = j;
-          return &tochcas[i];
-        }
-      }
-    }
+  while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline,
+                                  NULL)) {
   }
-  return NULL;
-}
-
-static bool detect_collieded_with_invader(struct vector2 *point,
-                                          struct invader *invader) {
-  return (invader->alive &&
-          detect_collided(point, NULL, &invader->position, &invader->size));
-}
-
-static void invoke_event(struct invaders_game *game, enum game_event event) {
-  game->event = event;
-  game->event_caption.displaying = true;
-  clear_timer(&game->event_caption.timer);
 }
 
-static void update_game_on_ingame_scene(struct invaders_game *game,
-                                        long elapsed_time, int *scene_change) {
-  int i, j, k, n_living_invaders, invader_move_speed, block_hit_with, n_living_lines;
-  bool stepable, is_annihilation;
-  struct invader *shooting_invader, *line_head_invader,
-    *line_head_invaders[N_INVADERS_LAYOUT_Y], *invader_hit_with;
-  struct tochca *tochca_hit_with;
-  struct vector2 block_position;
-
-  if (GAME_EVENT_NONE == game->event) {
-    /* Interpret the key inputs */
-    switch (getch()) {
-      case 'a':
-      case KEY_LEFT:
-        --game->player_jet.position.y;
-        break;
-      case 'd':
-      case KEY_RIGHT:
-        ++game->player_jet.position.y;
-        break;
-      case 'w':
-      case KEY_UP:
-        if (!game->player_bullet.active) {
-          game->player_bullet.active = true;
-          memcpy(&game->player_bullet.position,
-                 &game->player_jet.position,
-                 sizeof(game->player_bullet.position));
-          ++game->player_bullet.position.y;
-          clear_timer(&game->player_bullet.moving_timer);
-        }
-        break;
-      default:
-        break;
-    }
-
-
-    /* Decide the current aggression level */
-    n_living_invaders = 0;
-    n_living_lines = 0;
-    memset(line_head_invaders, 0, sizeof(line_head_invaders));
-    for (i = 0; i < N_INVADERS_LAYOUT_Y; ++i) {
-      line_head_invader = NULL;
-      for (j = N_INVADERS_LAYOUT_X - 1; j >= 0; --j) {
-        struct invader *invader = &game->invader_team.members[i
-            * N_INVADERS_LAYOUT_X + j];
-        if (invader->alive) {
-          ++n_living_invaders;
-          if (NULL == line_head_invader) {
-            line_head_invader = invader;
-          }
-        }
-      }
-      if (NULL != line_head_invader) {
-        line_head_invaders[n_living_lines] = line_head_invader;
-        ++n_living_lines;
-      }
-    }
-    if (LEVEL7_THRESHOLD >= n_living_invaders) {
-      invader_move_speed = LEVEL7_MOVE_SPEED;
-    } else if (LEVEL6_THRESHOLD >= n_living_invaders) {
-      invader_move_speed = LEVEL6_MOVE_SPEED;
-    } else if (LEVEL5_THRESHOLD >= n_living_invaders) {
-      invader_move_speed = LEVEL5_MOVE_SPEED;
-    } else if (LEVEL4_THRESHOLD >= n_living_invaders) {
-      invader_move_speed = LEVEL4_MOVE_SPEED;
-    } else if (LEVEL3_THRESHOLD >= n_living_invaders) {
-      invader_move_speed = LEVEL3_MOVE_SPEED;
-    } else if (LEVEL2_THRESHOLD >= n_living_invaders) {
-      invader_move_speed = LEVEL2_MOVE_SPEED;
-    } else if (LEVEL1_THRESHOLD >= n_living_invaders) {
-      invader_move_speed = LEVEL1_MOVE_SPEED;
-    } else {
-      invader_move_speed = LEVEL0_MOVE_SPEED;
-    }
-
-    /* The commander invader appear on schedule */
-    if (!game->invader_team.commander.alive &&
-        count_timer(&game->invader_team.commander_turn_timer, elapsed_time)) {
-      game->invader_team.commander.alive = true;
-      game->invader_team.commander.position.x = COMMANDER_INVADER_START_POSITION_X;
-      game->invader_team.commander.position.y = COMMANDER_INVADER_START_POSITION_Y;
-      clear_timer(&game->invader_team.commander.moving_timer);
-    }
-
-    /* move the invaders */
-    stepable = false;
-    for (i = 0; i < N_ELEMENTS(game->invader_team.members); ++i) {
-      if (game->invader_team.members[i].alive) {
-        if (0 > game->invader_team.members[i].moving_speed_y
-            &&
-            INVADER_MOVING_RANGE_Y_MIN
-                >= game->invader_team.members[i].position.y) {
-          stepable = true;
-          break;
-        } else if (0 < game->invader_team.members[i].moving_speed_y
-            &&
-            INVADER_MOVING_RANGE_Y_MAX
-                <= game->invader_team.members[i].position.y) {
-          stepable = true;
-          break;
-        }
-      }
-    }
-    for (i = 0; i < N_ELEMENTS(game->invader_team.members); ++i) {
-      if (game->invader_team.members[i].alive) {
-        if (count_timer(&game->invader_team.members[i].moving_timer,
-                        elapsed_time * invader_move_speed / 100)) {
-          if (stepable) {
-            game->invader_team.members[i].position.x += INVADER_INVASION_STEP_X;
-            game->invader_team.members[i].moving_speed_y *= -1;
-          } else {
-            game->invader_team.members[i].position.y += game->invader_team
-                .members[i].moving_speed_y;
-          }
-        }
-      }
-    }
-    if (game->invader_team.commander.alive) {
-      if (INVADER_MOVING_RANGE_Y_MAX <= game->invader_team.commander.position.y) {
-        game->invader_team.commander.alive = false;
-        clear_timer(&game->invader_team.commander_turn_timer);
-      } else if (count_timer(&game->invader_team.commander.moving_timer, elapsed_time)) {
-        ++game->invader_team.commander.position.y;
-      }
-    }
-
-    /* Make the invader to shoot his bullet */
-    if (count_timer(&game->invader_team.shooting_timer, elapsed_time)) {
-      shooting_invader = line_head_invaders[rand() % n_living_lines];
-      assert(NULL != shooting_invader);
-      for (i = 0; i < N_ELEMENTS(game->invader_bullets); ++i) {
-        if (!game->invader_bullets[i].active) {
-          game->invader_bullets[i].active = true;
-          memcpy(&game->invader_bullets[i].position, &shooting_invader->position,
-                 sizeof(game->invader_bullets[i].position));
-          game->invader_bullets[i].position.x += 2;
-          ++game->invader_bullets[i].position.y;
-          clear_timer(&game->invader_bullets[i].moving_timer);
-          break;
-        }
-      }
-    }
-
-    /* move bullets */
-    move_bullet(&game->player_bullet, elapsed_time);
-    for (i = 0; i < N_ELEMENTS(game->invader_bullets); ++i) {
-      move_bullet(&game->invader_bullets[i], elapsed_time);
-    }
-
-    /* Detect player bullet hit */
-    if (game->player_bullet.active) {
-      tochca_hit_with = detect_collieded_with_tochcas(&game->player_bullet.position,
-                                                      game->tochcas,
-                                                      N_ELEMENTS(game->tochcas),
-                                                      &block_hit_with);
-      if (NULL != tochca_hit_with) {
-        game->player_bullet.active = false;
-        tochca_hit_with->block_standings[block_hit_with] = false;
-      } else {
-        invader_hit_with = NULL;
-        for (j = 0; j < N_ELEMENTS(game->invader_team.members); ++j) {
-          if (detect_collieded_with_invader(&game->player_bullet.position,
-                                            &game->invader_team.members[j])) {
-            invader_hit_with = &game->invader_team.members[j];
-            break;
-          }
-        }
-        if (NULL == invader_hit_with) {
-          if (game->invader_team.commander.alive &&
-              detect_collided(&game->player_bullet.position, NULL,
-                              &game->invader_team.commander.position,
-                              &game->invader_team.commander.size)) {
-            invader_hit_with = &game->invader_team.commander;
-          }
-        }
-        if (NULL != invader_hit_with) {
-          game->player_bullet.active = false;
-          invader_hit_with->alive = false;
-          game->score +=
-              (COMMANDER_INVADER == invader_hit_with->type) ?
-              COMMANDER_INVADER_SCORE :
-              (SENIOR_INVADER == invader_hit_with->type) ?
-              SENIOR_INVADER_SCORE :
-              (YOUNG_INVADER == invader_hit_with->type) ?
-                  YOUNG_INVADER_SCORE : LOOKIE_INVADER_SCORE;
-        }
-      }
-    }
-
-    /* Detect invader bullet hit */
-    for (i = 0; i < N_ELEMENTS(game->invader_bullets); ++i) {
-      struct bullet *bullet = &game->invader_bullets[i];
-      if (bullet->active) {
-        if (detect_collided(&bullet->position, NULL, &game->player_jet.position,
-                            &game->player_jet.size)) {
-          bullet->active = false;
-          if (0 < game->credit) {
-            game->credit -= 1;
-          } else {
-            invoke_event(game, GAME_OVER_EVENT);
-          }
-        } else if (game->player_bullet.active &&
-                   game->player_bullet.position.x <= bullet->position.x &&
-                   game->player_bullet.position.y == bullet->position.y) {
-          game->player_bullet.active = false;
-          bullet->active = false;
-        } else {
-          tochca_hit_with = detect_collieded_with_tochcas(&bullet->position,
-                                                          (struct tochca *) game->tochcas,
-                                                          N_ELEMENTS(game->tochcas),
-                                                          &block_hit_with);
-          if (NULL != tochca_hit_with) {
-            bullet->active = false;
-            tochca_hit_with->block_standings[block_hit_with] = false;
-          }
-        }
-      }
-    }
-
-    /* Detect invaders hit with tochcas */
-    for (i = 0; i < N_ELEMENTS(game->tochcas); ++i) {
-      for (j = 0; j < N_ELEMENTS(game->tochcas[i].block_standings); ++j) {
-        if (game->tochcas[i].block_standings[j]) {
-          for (k = 0; k < N_ELEMENTS(game->invader_team.members); ++k) {
-            get_tochca_block_position(&game->tochcas[i], j, &block_position);
-            if (detect_collieded_with_invader(&block_position,
-                                              &game->invader_team.members[k])) {
-              game->tochcas[i].block_standings[j] = false;
-              break;
-            }
-          }
-        }
+/**
+ * Tick the session against absolute deadlines, so that the simulated time
+ * keeps up with the wall clock however long the terminal output stalls
+ */
+static void *run_simulation(void *argument) {
+  struct game_loop *loop = argument;
+  struct render_snapshot *snapshot;
+  struct timespec deadline;
+  struct key_input input;
+  long tick_nsec;
+
+  tick_nsec = 1000000000L / SIMULATION_TICK_RATE;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  while (!__atomic_load_n(&loop->quitting, __ATOMIC_ACQUIRE)) {
+    /* Hold the keys back while the peer is too far behind to roll back */
+    if (NULL != loop->versus_link) {
+      receive_versus_keys(loop->versus_link, &loop->rollback);
+      if (!can_advance_rollback(&loop->rollback)) {
+        ++loop->n_stalled_ticks;
+        wait_next_tick(loop, &deadline, tick_nsec);
+        continue;
       }
     }
-
-    /* Check the annihilation */
-    is_annihilation = true;
-    for (i = 0; i < N_ELEMENTS(game->invader_team.members); ++i) {
-      if (game->invader_team.members[i].alive) {
-        is_annihilation = false;
-        break;
-      }
+    if (!pop_key(&loop->key_queue, &input)) {
+      input.key = ERR;
     }
-    if (is_annihilation) {
-      invoke_event(game, GAME_CLEAR_EVENT);
+    if (NULL != loop->versus_link) {
+      send_versus_key(loop->versus_link, &loop->rollback, input.key);
+      advance_rollback(&loop->rollback, &loop->session, input.key);
+    } else {
+      update_game_session(&loop->session, input.key,
+                          get_tick_elapsed_time(loop->n_ticks));
     }
-
-    /* Detect player jet hit with the invaders */
-    if (GAME_EVENT_NONE == game->event) {
-      for (i = 0; i < N_ELEMENTS(game->invader_team.members); ++i) {
-        if (game->invader_team.members[i].alive &&
-            detect_collided(&game->player_jet.position,
-                            &game->player_jet.size,
-                            &game->invader_team.members[i].position,
-                            &game->invader_team.members[i].size)) {
-          invoke_event(game, GAME_OVER_EVENT);
-          break;
-        }
-      }
+    ++loop->n_ticks;
+    if (INGAME_SCENE == loop->session.scene) {
+      set_metric(loop->session.metrics, LEVEL_SPEED_METRIC,
+                 get_game_level_speed(&loop->session.game));
+      set_metric(loop->session.metrics, ACTIVE_BULLETS_METRIC,
+                 count_active_bullets(&loop->session.game));
+    } else {
+      set_metric(loop->session.metrics, LEVEL_SPEED_METRIC, 0L);
+      set_metric(loop->session.metrics, ACTIVE_BULLETS_METRIC, 0L);
     }
 
-    /* Check the invasion */
-    if (GAME_EVENT_NONE == game->event) {
-      for (i = 0; i < n_living_lines; ++i) {
-        if (line_head_invaders[i]->alive &&
-            INVADER_INVASION_THRESHOLD_POSITION_X
-            <= line_head_invaders[i]->position.x + 1) {
-          invoke_event(game, GAME_OVER_EVENT);
-          break;
-        }
-      }
+    /* Tell the render thread which tick has to be shown for the key */
+    if (ERR != input.key) {
+      input.tick = loop->n_ticks;
+      push_key(&loop->applied_key_queue, &input);
     }
-  } else {
-    /* Clean the input buffer */
-    getch();
-  }
 
-  /* Update the caption timer */
-  if (game->event_caption.displaying
-      && count_timer(&game->event_caption.timer, elapsed_time)) {
-    game->event_caption.displaying = false;
-    *scene_change = TITLE_SCENE;
-  }
-}
-
-void draw_invader(struct invader *invader) {
-  if (invader->alive) {
-    switch (invader->type) {
-      case COMMANDER_INVADER:
-        attron(COLOR_PAIR(COMMANDER_INVADER_COLOR_PAIR));
-        break;
-      case SENIOR_INVADER:
-        attron(COLOR_PAIR(SENIOR_INVADER_COLOR_PAIR));
-        break;
-      case YOUNG_INVADER:
-        attron(COLOR_PAIR(YOUNG_INVADER_COLOR_PAIR));
-        break;
-      default:
-        attron(COLOR_PAIR(LOOKIE_INVADER_COLOR_PAIR));
-        break;
-    }
-    move(invader->position.x, invader->position.y);
-    addch(INVADER_RENDERING_CHAR);
-    addch(INVADER_RENDERING_CHAR);
-    addch(INVADER_RENDERING_CHAR);
-    move(invader->position.x + 1, invader->position.y);
-    addch(INVADER_RENDERING_CHAR);
-    addch(INVADER_RENDERING_CHAR);
-    addch(INVADER_RENDERING_CHAR);
+    /* Publish the tick; the render thread picks the latest one up */
+    snapshot = &loop->snapshots[loop->snapshot_buffer.back];
+    memcpy(&snapshot->session, &loop->session, sizeof(snapshot->session));
+    snapshot->tick = loop->n_ticks;
+    publish_triple_buffer(&loop->snapshot_buffer);
+    wait_next_tick(loop, &deadline, tick_nsec);
   }
+  return NULL;
 }
 
-static void draw_ingame_scene(struct invaders_game *game) {
-  int i, j;
-
-  /* Render the player jet */
-  if (0 <= game->credit) {
-    attron(COLOR_PAIR(PLAYER_JET_COLOR_PAIR));
-    move(game->player_jet.position.x, game->player_jet.position.y + 1);
-    addch(PLAYER_JET_RENDERING_CHAR);
-    move(game->player_jet.position.x + 1, game->player_jet.position.y);
-    addch(PLAYER_JET_RENDERING_CHAR);
-    addch(PLAYER_JET_RENDERING_CHAR);
-    addch(PLAYER_JET_RENDERING_CHAR);
-  }
-
-  /* Render the player bullet */
-  if (game->player_bullet.active) {
-    attron(COLOR_PAIR(PLAYER_BULLET_COLOR_PAIR));
-    move(game->player_bullet.position.x, game->player_bullet.position.y);
-    addch(PLAYER_BULLET_RENDERING_CHAR);
-  }
-
-  /* Render the tochcas */
-  attron(COLOR_PAIR(TOCHCA_COLOR_PAIR));
-  for (i = 0; i < N_ELEMENTS(game->tochcas); ++i) {
-    for (j = 0; j < N_ELEMENTS(game->tochcas[i].block_standings); ++j) {
-      if (game->tochcas[i].block_standings[j]) {
-        move(game->tochcas[i].position.x + (j % N_TOCHCA_BLOCKS_LAYOUT_X),
-             game->tochcas[i].position.y + (j / N_TOCHCA_BLOCKS_LAYOUT_X));
-        addch(TOCHCA_RENDERING_CHAR);
-      }
-    }
+int main(int argc, char **argv) {
+  int status;
+  struct key_input input;
+  struct latency_histogram key_latency;
+  long last_tick, n_skipped_snapshots;
+  bool simulating;
+  sigset_t signals, old_signals;
+  struct sigaction quit_action;
+  pthread_t simulation_thread;
+  struct pollfd stdin_poll;
+  struct timespec frame_deadline, publish_deadline, now;
+  struct metrics_shard *render_metrics;
+  long written_bytes;
+  struct render_snapshot *snapshot;
+  WINDOW *window;
+  struct sprite_atlas atlas;
+  struct render_buffer render_buffer;
+  struct logger error_logger;
+  struct logger stats_logger;
+  struct score_store score_store;
+  struct score_store *opened_score_store;
+  const char *tracepath;
+  const char *versuspath;
+  unsigned int seed;
+
+  /* Switch to the other modes on request */
+  if (2 <= argc && 0 == strcmp(argv[1], "--arcade")) {
+    return run_arcade(argc - 2, argv + 2);
   }
-
-  /* Render the invaders */
-  for (i = 0; i < N_ELEMENTS(game->invader_team.members); ++i) {
-    draw_invader(&game->invader_team.members[i]);
+  if (2 <= argc && 0 == strcmp(argv[1], "--arcade-bench")) {
+    return run_arcade_benchmark(argc - 2, argv + 2);
   }
-  draw_invader(&game->invader_team.commander);
-
-  /* Render the invader bullets */
-  for (i = 0; i < N_ELEMENTS(game->invader_bullets); ++i) {
-    if (game->invader_bullets[i].active) {
-      attron(COLOR_PAIR(INVADER_BULLET_COLOR_PAIR));
-      move(game->invader_bullets[i].position.x,
-           game->invader_bullets[i].position.y);
-      addch(INVADER_BULLET_RENDERING_CHAR);
-    }
+  if (2 <= argc && 0 == strcmp(argv[1], "--fuzz")) {
+    return run_fuzz(argc - 2, argv + 2);
   }
-
-  /* Render score HUD */
-  attron(COLOR_PAIR(SCORE_COLOR_PAIR));
-  move(SCORE_POSITION_X,
-       SCORE_POSITION_Y - 11/* the length of "SCORE: %04ld" */);
-  printw("SCORE: %04ld", game->score);
-
-  /* Render credit HUD */
-  attron(COLOR_PAIR(CREDIT_COLOR_PAIR));
-  move(CREDIT_POSITION_X, CREDIT_POSITION_Y);
-  printw("CREDIT: %d", game->credit);
-
-  /* Render caption HUD with blinking */
-  if (game->event_caption.displaying
-      && (EVENT_CAPTION_BLINKING_INTERVAL
-          <= game->event_caption.timer.counter % 1000L)) {
-    attron(COLOR_PAIR(EVENT_CAPTION_COLOR_PAIR));
-    const char *caption_text =
-        (GAME_CLEAR_EVENT == game->event) ?
-        GAME_CLEAR_CAPTION_TEXT : GAME_OVER_CAPTION_TEXT;
-    move(EVENT_CAPTION_POSITION_X,
-         EVENT_CAPTION_POSITION_Y - strlen(caption_text) / 2);
-    printw(caption_text);
+  if (2 <= argc && 0 == strcmp(argv[1], "--replay-bench")) {
+    return run_replay_benchmark(argc - 2, argv + 2);
   }
-}
-
-static void draw_canvas_frame() {
-  int i;
-
-  attron(COLOR_PAIR(CANVAS_FRAME_COLOR_PAIR));
-  move(0, 0);
-  for (i = 0; i < CANVAS_SIZE_Y; ++i) {
-    addch(CANVAS_FRAME_RENDERING_CHAR);
+  if (2 <= argc && 0 == strcmp(argv[1], "--rollback-bench")) {
+    return run_rollback_benchmark(argc - 2, argv + 2);
   }
-  for (i = 0; i < CANVAS_SIZE_X; ++i) {
-    move(i, 0);
-    addch(CANVAS_FRAME_RENDERING_CHAR);
-    move(i, CANVAS_SIZE_Y - 1);
-    addch(CANVAS_FRAME_RENDERING_CHAR);
+  tracepath = NULL;
+  if (3 <= argc && 0 == strcmp(argv[1], "--trace")) {
+    tracepath = argv[2];
   }
-  move(CANVAS_SIZE_X - 1, 0);
-  for (i = 0; i < CANVAS_SIZE_Y; ++i) {
-    addch(CANVAS_FRAME_RENDERING_CHAR);
+  versuspath = NULL;
+  if (3 <= argc && 0 == strcmp(argv[1], "--versus")) {
+    versuspath = argv[2];
   }
-}
-
-int main(int argc, char **argv) {
-  int status, scene, next_scene;
-  char errmsg[128];
-  long elapsed_msec, wait_msec;
-  struct timespec wait_time, left_time;
-  struct timeval frame_start_time, frame_end_time;
-  WINDOW *window;
-  struct invaders_game game;
-  struct logger error_logger;
-
-  UNUSED(argc);
-  UNUSED(argv);
 
   /* Initialize for ncurses library */
+  /* Leave out SA_RESTART, so that a quit breaks the wait for the peer */
+  memset(&quit_action, 0, sizeof(quit_action));
+  quit_action.sa_handler = request_quit;
+  sigemptyset(&quit_action.sa_mask);
+  sigaction(SIGINT, &quit_action, NULL);
+  sigaction(SIGTERM, &quit_action, NULL);
   reset_logger(&error_logger, ERRORLOG_FILEPATH);
+  reset_logger(&stats_logger, STATSLOG_FILEPATH);
+  reset_render_buffer(&render_buffer);
+  reset_latency_histogram(&key_latency);
+  reset_metrics(&metrics, METRICS_FILEPATH_FORMAT);
+  render_metrics = claim_metrics_shard(&metrics, "render");
+  open_output_meter(render_metrics);
   status = 1;
+  opened_score_store = NULL;
+  simulating = false;
+  game_loop.session.trace_writer = NULL;
+  game_loop.versus_link = NULL;
+  seed = (unsigned int) (time(NULL) ^ getpid());
+
+  /* Meet the other player before taking the terminal over */
+  if (NULL != versuspath) {
+    if (!open_versus_link(&versus_link, versuspath, seed, &error_logger)) {
+      goto cleanup;
+    }
+    game_loop.versus_link = &versus_link;
+    seed = versus_link.seed;
+    reset_rollback(&game_loop.rollback, versus_link.local_player);
+  }
   window = initscr();
-  if (ERR == wresize(window, CANVAS_SIZE_X, CANVAS_SIZE_Y)) {
-    emit_log(&error_logger,
-             "Failed to change the ncurses setting for window size");
+  if (!setup_game_screen(window, &error_logger)) {
     goto cleanup;
   }
-  if (ERR == keypad(window, true)) {
-    emit_log(&error_logger,
-             "Failed to change the ncurses setting for key input receiving");
-    goto cleanup;
+  compose_sprite_atlas(&atlas);
+  if (open_score_store(&score_store, SCORE_STORE_FILEPATH)) {
+    opened_score_store = &score_store;
+  } else {
+    emit_log(&error_logger, "Failed to open the score store: path=%s",
+             SCORE_STORE_FILEPATH);
   }
-  if (ERR == noecho()) {
-    emit_log(&error_logger,
-             "Failed to change the ncurses setting for echoing setting");
-    goto cleanup;
+
+  /*
+   * Execute game loop. The versus mode keeps the scores, the trace and the
+   * counters out, as the ticks simulated again would record twice.
+   */
+  if (NULL != game_loop.versus_link) {
+    reset_game_session(&game_loop.session, seed, NULL);
+    game_loop.session.n_players = MAX_PLAYERS;
+  } else {
+    reset_game_session(&game_loop.session, seed, opened_score_store);
+    game_loop.session.metrics = claim_metrics_shard(&metrics, "simulation");
   }
-  curs_set(0);
-  timeout(0);
-  if (has_colors() && can_change_color()) {
-    if (ERR == start_color()) {
-      emit_log(&error_logger,
-               "Failed to change the ncurses setting to set up coloring");
-      goto cleanup;
-    }
-    if ((ERR == init_pair(PLAYER_JET_COLOR_PAIR, PLAYER_JET_COLOR, COLOR_BLACK))
-        || (ERR == init_pair(PLAYER_BULLET_COLOR_PAIR, PLAYER_BULLET_COLOR,
-        COLOR_BLACK))
-        || (ERR == init_pair(TOCHCA_COLOR_PAIR, TOCHCA_COLOR, COLOR_BLACK))
-        || (ERR == init_pair(COMMANDER_INVADER_COLOR_PAIR, COMMANDER_INVADER_COLOR,
-            COLOR_BLACK))
-        || (ERR == init_pair(SENIOR_INVADER_COLOR_PAIR, SENIOR_INVADER_COLOR,
-        COLOR_BLACK))
-        || (ERR == init_pair(YOUNG_INVADER_COLOR_PAIR, YOUNG_INVADER_COLOR,
-        COLOR_BLACK))
-        || (ERR == init_pair(LOOKIE_INVADER_COLOR_PAIR, LOOKIE_INVADER_COLOR,
-        COLOR_BLACK))
-        || (ERR == init_pair(INVADER_BULLET_COLOR_PAIR, INVADER_BULLET_COLOR,
-        COLOR_BLACK))
-        || (ERR == init_pair(TITLE_COLOR_PAIR, TITLE_COLOR, COLOR_BLACK))
-        || (ERR == init_pair(EVENT_CAPTION_COLOR_PAIR, EVENT_CAPTION_COLOR,
-        COLOR_BLACK))
-        || (ERR == init_pair(SCORE_COLOR_PAIR, SCORE_COLOR, COLOR_BLACK))
-        || (ERR == init_pair(CREDIT_COLOR_PAIR, CREDIT_COLOR, COLOR_BLACK))
-        || (ERR
-            == init_pair(CANVAS_FRAME_COLOR_PAIR, CANVAS_FRAME_COLOR, COLOR_BLACK))) {
-      emit_log(&error_logger,
-               "Failed to change the ncurses setting to define color pair");
-      goto cleanup;
+  if (NULL != tracepath) {
+    if (open_trace_writer(&trace_writer, tracepath)) {
+      game_loop.session.trace_writer = &trace_writer;
+    } else {
+      emit_log(&error_logger, "Failed to open the trace: path=%s", tracepath);
     }
-
   }
+  reset_triple_buffer(&game_loop.snapshot_buffer);
+  reset_key_queue(&game_loop.key_queue);
+  reset_key_queue(&game_loop.applied_key_queue);
+
+  /* Leave the signals to this thread, which watches the quit request */
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+  status = pthread_create(&simulation_thread, NULL, run_simulation,
+                          &game_loop);
+  pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+  if (0 != status) {
+    emit_log(&error_logger, "Failed to start the simulation: errno=%d",
+             status);
+    status = 1;
+    goto cleanup;
+  }
+  simulating = true;
+  status = 1;
 
-  /* Execute game loop */
-  scene = -1;
-  next_scene = TITLE_SCENE;
-  while (1) {
-    /* Record the frame starting time */
-    if (0 != gettimeofday(&frame_start_time, NULL)) {
-      emit_log(&error_logger, "Failed to get time of frame starting");
-      goto cleanup;
+  last_tick = 0L;
+  n_skipped_snapshots = 0L;
+  stdin_poll.fd = STDIN_FILENO;
+  stdin_poll.events = POLLIN;
+  clock_gettime(CLOCK_MONOTONIC, &frame_deadline);
+  publish_deadline = frame_deadline;
+  while (!quit_requested) {
+    /* Forward the keys; they are dropped while the simulation is behind */
+    while (ERR != (input.key = getch())) {
+      input.read_nsec = get_clock_nsec(CLOCK_MONOTONIC);
+      push_key(&game_loop.key_queue, &input);
     }
 
-    /* Change the next scene if needed */
-    if (scene != next_scene) {
-      scene = next_scene;
-      if (INGAME_SCENE == scene) {
-        reset_game(&game);
+    /* Wait for the next input until the frame is due */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (0L < get_msec_until(&now, &frame_deadline)) {
+      if (-1 == poll(&stdin_poll, 1,
+                     (int) get_msec_until(&now, &frame_deadline))
+          && EINTR != errno) {
+        emit_log(&error_logger, "Failed to wait for the input: errno=%d",
+                 errno);
+        goto cleanup;
       }
+      continue;
     }
 
-    /* Update the objects */
-    if (TITLE_SCENE == scene) {
-      update_game_on_title_scene(&next_scene);
-    } else if (INGAME_SCENE == scene) {
-      update_game_on_ingame_scene(&game, IDEAL_FRAME_TIME, &next_scene);
+    /* Render the latest snapshot; a stalled frame is not made up for */
+    advance_deadline(&frame_deadline, RENDER_FRAME_TIME * 1000000L);
+    if (0L == get_msec_until(&now, &frame_deadline)) {
+      frame_deadline = now;
+      advance_deadline(&frame_deadline, RENDER_FRAME_TIME * 1000000L);
+      count_metric(render_metrics, LATE_FRAMES_METRIC, 1L);
     }
-
-    /* Render the objects */
-    erase();
-    if (TITLE_SCENE == scene) {
-      draw_title_scene();
-    } else if (INGAME_SCENE == scene) {
-      draw_ingame_scene(&game);
+    if (acquire_triple_buffer(&game_loop.snapshot_buffer)) {
+      snapshot = &game_loop.snapshots[game_loop.snapshot_buffer.front];
+      n_skipped_snapshots += snapshot->tick - last_tick - 1;
+      last_tick = snapshot->tick;
+      erase();
+      draw_game_session(&snapshot->session, &atlas, &render_buffer);
+      flush_render_buffer(&render_buffer, stdscr);
+      written_bytes = read_output_meter(render_metrics);
+      refresh();
+      count_metric(render_metrics, OUTPUT_BYTES_METRIC,
+                   read_output_meter(render_metrics) - written_bytes);
+      count_metric(render_metrics, FRAMES_RENDERED_METRIC, 1L);
+
+      /* Measure the keys whose ticks have just reached the screen */
+      while (peek_key(&game_loop.applied_key_queue, &input)
+          && last_tick >= input.tick) {
+        pop_key(&game_loop.applied_key_queue, &input);
+        count_latency(&key_latency,
+                      (get_clock_nsec(CLOCK_MONOTONIC) - input.read_nsec)
+                          / 1000L);
+      }
     }
-    draw_canvas_frame();
-    refresh();
 
-    /* Adjust the frame interval */
-    if (0 != gettimeofday(&frame_end_time, NULL)) {
-      emit_log(&error_logger, "Failed to get time of frame finished");
-      goto cleanup;
-    }
-    elapsed_msec = (frame_end_time.tv_sec - frame_start_time.tv_sec) * 1000L
-        + (frame_end_time.tv_usec - frame_start_time.tv_usec) / 1000000L;
-    wait_msec = IDEAL_FRAME_TIME - elapsed_msec;
-    if (0L < wait_msec) {
-      wait_time.tv_sec = 0;
-      wait_time.tv_nsec = wait_msec * 1000000L;
-      while (-1 == nanosleep(&wait_time, &left_time)) {
-        if (EINTR == errno) {
-          memcpy(&wait_time, &left_time, sizeof(struct timespec));
-        } else {
-          if (0 == strerror_r(errno, errmsg, sizeof(errmsg))) {
-            emit_log(
-                &error_logger,
-                "Failed to sleep until the end of frame: errmsg=%s, sleeping_msec=%ld",
-                errmsg, wait_msec);
-          } else {
-            emit_log(&error_logger, "Failed to get error message: errno=%d",
-            errno);
-          }
-          goto cleanup;
-        }
+    /* Publish the metrics on schedule */
+    if (0L == get_msec_until(&now, &publish_deadline)) {
+      publish_deadline = now;
+      advance_deadline(&publish_deadline, METRICS_PUBLISH_INTERVAL * 1000000L);
+      if (!publish_metrics(&metrics)) {
+        emit_log(&error_logger, "Failed to publish the metrics: path=%s",
+                 metrics.path);
       }
     }
   }
@@ -782,6 +367,64 @@ int main(int argc, char **argv) {
 
  cleanup:
   endwin();
+  if (simulating) {
+    __atomic_store_n(&game_loop.quitting, true, __ATOMIC_RELEASE);
+    pthread_join(simulation_thread, NULL);
+    emit_log(&stats_logger,
+             "Simulated ticks: ticks=%ld, late_ticks=%ld, "
+             "skipped_snapshots=%ld",
+             game_loop.n_ticks, game_loop.n_late_ticks, n_skipped_snapshots);
+  }
+  if (NULL != game_loop.versus_link) {
+    if (versus_link.desynced) {
+      emit_log(&error_logger, "Desynced from the versus peer: tick=%d",
+               versus_link.desynced_tick);
+    }
+    emit_log(&stats_logger,
+             "Versus link: player=%d, sent=%ld, received=%ld, "
+             "disconnected=%d, stalled_ticks=%ld, rollbacks=%ld, "
+             "resimulated_ticks=%ld, max_rollback_ticks=%d, "
+             "max_rollback_usec=%ld",
+             versus_link.local_player, versus_link.n_sent,
+             versus_link.n_received, versus_link.disconnected,
+             game_loop.n_stalled_ticks, game_loop.rollback.n_rollbacks,
+             game_loop.rollback.n_resimulated_ticks,
+             game_loop.rollback.max_rollback_ticks,
+             game_loop.rollback.max_rollback_nsec / 1000L);
+    close_versus_link(&versus_link);
+  }
+  if (NULL != game_loop.session.trace_writer) {
+    if (!close_trace_writer(game_loop.session.trace_writer)) {
+      emit_log(&error_logger, "Failed to write the trace: path=%s", tracepath);
+    }
+    emit_log(&stats_logger, "Traced ticks: ticks=%ld, bytes=%ld",
+             trace_writer.n_ticks, trace_writer.n_bytes);
+  }
+  if (NULL != opened_score_store) {
+    close_score_store(opened_score_store);
+  }
+  if (0L < render_buffer.n_frames) {
+    emit_log(&stats_logger,
+             "Rendered frames: frames=%ld, color_switches=%ld, "
+             "color_switches_per_frame=%.2f",
+             render_buffer.n_frames, render_buffer.n_color_switches,
+             (double) render_buffer.n_color_switches / render_buffer.n_frames);
+  }
+  if (0L < render_buffer.n_dropped_commands) {
+    emit_log(&error_logger, "Dropped render commands: commands=%ld",
+             render_buffer.n_dropped_commands);
+  }
+  emit_latency_histogram(&stats_logger, "key_to_screen", &key_latency);
+  close_output_meter(render_metrics);
+  publish_metrics(&metrics);
+  retract_metrics(&metrics);
+  if (0L < key_latency.n_samples) {
+    printf("key_to_screen_latency: samples=%ld p50_usec=%ld p99_usec=%ld "
+           "max_usec=%ld\n",
+           key_latency.n_samples, get_latency_percentile(&key_latency, 0.50),
+           get_latency_percentile(&key_latency, 0.99), key_latency.max_usec);
+  }
+  close_logger(&stats_logger);
   close_logger(&error_logger);
   return status;
 }
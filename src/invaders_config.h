@@ -10,13 +10,75 @@
 
 /* Definitions for the entire game */
 #define ERRORLOG_FILEPATH ("./invaders_error.log")
+#define STATSLOG_FILEPATH ("./invaders_stats.log")
 #define IDEAL_FRAME_TIME (1000L / 30L)
 #define CANVAS_SIZE_X (36)
 #define CANVAS_SIZE_Y (80)
+/* No longer than the shortest moving interval, to fire each timer once a step */
+#define SIMULATION_STEP_TIME (PLAYER_BULLET_MOVING_INTERVAL)
+/* The simulation ticks at its own rate; the frames show the latest tick */
+#define SIMULATION_TICK_RATE (240L)
+#define RENDER_FRAME_TIME (IDEAL_FRAME_TIME)
+/* The budget of one packed game state, checked on compilation */
+#define INVADERS_GAME_SIZE_TARGET (1792)
+
+/* Definitions for the arcade server */
+#define ARCADE_MAX_SESSIONS (256)
+#define ARCADE_KEY_QUEUE_SIZE (16)
+#define ARCADE_MAX_EVENTS (64)
+#define ARCADE_BENCHMARK_TERM ("xterm")
+#define ARCADE_BENCHMARK_SCREEN_SIZE_X (CANVAS_SIZE_X + 4)
+#define ARCADE_BENCHMARK_SCREEN_SIZE_Y (CANVAS_SIZE_Y + 20)
+#define ARCADE_BENCHMARK_DEFAULT_TICKS (1000L)
+
+/* Definitions for the score store */
+#define SCORE_STORE_FILEPATH ("./invaders_scores.db")
+#define SCORE_STORE_MAGIC (0x53564e49U)
+#define SCORE_STORE_CAPACITY (1L << 20)
+#define SCORE_STORE_TOP_N (5)
+
+/* Definitions for the state trace */
+#define TRACE_FILE_MAGIC (0x52545649U)
+#define TRACE_CHUNK_MAGIC (0x4b4e4843U)
+#define TRACE_CHUNK_TICKS (256)
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+/* Definitions for the live metrics */
+/* Filled in with the process id, as the instances may share a directory */
+#define METRICS_FILEPATH_FORMAT ("./invaders_metrics.%ld.prom")
+#define METRICS_FILEPATH_MAX_LENGTH (256)
+#define METRICS_MAX_SHARDS (16)
+#define METRICS_PUBLISH_INTERVAL (1000L)
+
+/* Definitions for the replay benchmark */
+#define REPLAY_BENCHMARK_BASELINE_FILEPATH ("./invaders_bench_baseline.txt")
+#define REPLAY_BENCHMARK_TERM ("xterm")
+#define REPLAY_BENCHMARK_SEEDS { 20150901U, 20150915U, 20150926U, 20151003U }
+#define REPLAY_BENCHMARK_MAX_TICKS (SIMULATION_TICK_RATE * 120L)
+/* Boards of n x n canvases tiled on one screen */
+#define REPLAY_BENCHMARK_SCALES { 1, 2, 4 }
+#define REPLAY_BENCHMARK_MAX_SCALE (4)
+/* The fastest of the repetitions counts, as the noise only slows down */
+#define REPLAY_BENCHMARK_REPETITIONS (7)
+/* A relative loss beyond which the benchmark fails */
+#define REPLAY_BENCHMARK_TOLERANCE (0.10)
+
+/* Definitions for the versus mode */
+#define VERSUS_HELLO_MAGIC (0x53524556U) /* "VERS" */
+/* The ticks a player may run ahead of the inputs confirmed by the peer */
+#define ROLLBACK_WINDOW (16)
+#define ROLLBACK_BENCHMARK_TICKS (SIMULATION_TICK_RATE * 600L)
+#define ROLLBACK_BENCHMARK_LATENCY (6)
+
+/* Definitions for the fuzzing harness */
+#define FUZZ_DEFAULT_TICKS (1000000L)
+#define FUZZ_MAX_ELAPSED_TIME (1000L)
+#define FUZZ_RANDOM_COLLISIONS_PER_TICK (4)
 
 /* Definitions for in-game entities */
 #define PLAYER_JET_POSITION_X (CANVAS_SIZE_X - 6)
-#define PLAYER_JET_START_POSITION_Y (7)
+#define MAX_PLAYERS (2)
+#define PLAYER_JET_START_POSITIONS_Y { 7, CANVAS_SIZE_Y - 10 }
 #define PLAYER_JET_SIZE_X (2)
 #define PLAYER_JET_SIZE_Y (3)
 #define PLAYER_BULLET_MOVING_INTERVAL (15L)
@@ -51,6 +113,22 @@
 #define INVADER_INVASION_THRESHOLD_POSITION_X (PLAYER_JET_POSITION_X)
 #define N_INVADER_BULLETS (20)
 #define INVADER_BULLET_MOVING_INTERVAL (80L)
+#define BULLET_MOVING_RANGE_X_MIN (2)
+#define BULLET_MOVING_RANGE_X_MAX (CANVAS_SIZE_X - 3)
+#define BULLET_MOVING_RANGE_Y_MIN (1)
+#define BULLET_MOVING_RANGE_Y_MAX (CANVAS_SIZE_Y - 2)
+
+/* Definitions for behaviour scripts */
+#define MAX_BEHAVIOUR_SCRIPTS (8)
+
+/* Definitions for the entity store */
+#define MAX_ENTITIES \
+  (N_INVADER_BULLETS + N_INVADERS + N_TOCHCAS + 2 * MAX_PLAYERS + 1)
+#define MAX_MOVING_ENTITIES (N_INVADER_BULLETS + MAX_PLAYERS)
+#define MAX_BLOCK_ENTITIES (N_TOCHCAS)
+#define N_COLLISION_LAYERS (2)
+#define COLLISION_GRID_SIZE_X (CANVAS_SIZE_X)
+#define COLLISION_GRID_SIZE_Y (CANVAS_SIZE_Y)
 
 /* Definitions for meta AI */
 #define LEVEL0_MOVE_SPEED (100)
@@ -69,10 +147,25 @@
 #define LEVEL7_THRESHOLD (1)
 #define LEVEL7_MOVE_SPEED (4000)
 
+/*
+ * Definitions for the render command buffer: a sprite per entity, a run per
+ * column of blocks at worst, and the canvas frame with the title and the
+ * top scores, which outnumber the in-game HUD texts
+ */
+#define N_TOCHCA_BLOCK_RENDER_RUNS \
+  (N_TOCHCA_BLOCKS_LAYOUT_X \
+   * ((N_TOCHCA_BLOCKS / N_TOCHCA_BLOCKS_LAYOUT_X + 1) / 2))
+#define N_HUD_RENDER_COMMANDS (4 + 1 + SCORE_STORE_TOP_N)
+#define N_RENDER_COMMANDS \
+  (MAX_ENTITIES - MAX_BLOCK_ENTITIES \
+   + MAX_BLOCK_ENTITIES * N_TOCHCA_BLOCK_RENDER_RUNS + N_HUD_RENDER_COMMANDS)
+
 /* Definitions for HUD objects */
 #define TITLE_TEXT ("THE INVADERS FROM GALAXY")
 #define TITLE_POSITION_X (CANVAS_SIZE_X / 2)
 #define TITLE_POSITION_Y (CANVAS_SIZE_Y / 2)
+#define HIGH_SCORE_POSITION_X (TITLE_POSITION_X + 2)
+#define HIGH_SCORE_POSITION_Y (TITLE_POSITION_Y - 8)
 #define SCORE_INITIAL_VALUE (0L)
 #define SCORE_POSITION_X (1)
 #define SCORE_POSITION_Y (CANVAS_SIZE_Y - 6)
@@ -88,11 +181,16 @@
 
 /* Definitions for rendering character */
 #define CANVAS_FRAME_RENDERING_CHAR '*'
-#define PLAYER_JET_RENDERING_CHAR 'o'
-#define PLAYER_BULLET_RENDERING_CHAR '|'
-#define TOCHCA_RENDERING_CHAR '='
-#define INVADER_RENDERING_CHAR 'x'
-#define INVADER_BULLET_RENDERING_CHAR '#'
+
+/* Definitions for sprite pattern (blank cells at both ends are transparent) */
+#define PLAYER_JET_SPRITE_PATTERN { " o ", "ooo" }
+#define PLAYER_BULLET_SPRITE_PATTERN { "|" }
+#define COMMANDER_INVADER_SPRITE_PATTERN { "xxx", "xxx" }
+#define SENIOR_INVADER_SPRITE_PATTERN { "xxx", "xxx" }
+#define YOUNG_INVADER_SPRITE_PATTERN { "xxx", "xxx" }
+#define LOOKIE_INVADER_SPRITE_PATTERN { "xxx", "xxx" }
+#define INVADER_BULLET_SPRITE_PATTERN { "#" }
+#define TOCHCA_BLOCK_SPRITE_PATTERN { "=" }
 
 /* Definitions for color */
 #define PLAYER_JET_COLOR (COLOR_CYAN)
@@ -104,6 +202,7 @@
 #define LOOKIE_INVADER_COLOR (COLOR_MAGENTA)
 #define INVADER_BULLET_COLOR (COLOR_MAGENTA)
 #define TITLE_COLOR (COLOR_YELLOW)
+#define HIGH_SCORE_COLOR (COLOR_WHITE)
 #define EVENT_CAPTION_COLOR (COLOR_YELLOW)
 #define SCORE_COLOR (COLOR_YELLOW)
 #define CREDIT_COLOR (COLOR_YELLOW)
@@ -0,0 +1,180 @@
+/*
+ * metrics.c
+ */
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+static const char *const counter_names[N_METRIC_COUNTERS][2] = {
+  { "invaders_ticks_total", "Simulation ticks run." },
+  { "invaders_frames_rendered_total", "Frames flushed to the terminals." },
+  { "invaders_late_frames_total", "Frames that missed their deadline." },
+  { "invaders_output_bytes_total", "Bytes written to the terminals." },
+  { "invaders_games_started_total", "Games started." },
+  { "invaders_game_clears_total", "Games cleared." },
+  { "invaders_game_overs_total", "Games over." },
+};
+
+static const char *const gauge_names[N_METRIC_GAUGES][2] = {
+  { "invaders_level_speed", "Current moving speed of the invaders." },
+  { "invaders_active_bullets", "Bullets currently in flight." },
+};
+
+/**
+ * Reset the metrics of this process, which are published to the path
+ * formatted with the process id and labelled with it as the instance
+ */
+void reset_metrics(struct metrics *metrics, const char *path_format) {
+  int i;
+
+  memset(metrics, 0, sizeof(*metrics));
+  metrics->instance = (long) getpid();
+  snprintf(metrics->path, sizeof(metrics->path), path_format,
+           metrics->instance);
+  for (i = 0; i < METRICS_MAX_SHARDS; ++i) {
+    metrics->shards[i].io_fd = -1;
+  }
+}
+
+/**
+ * Hand a shard over to the calling thread, or NULL when none is left.
+ * The shards are claimed while setting up, before the first publication.
+ */
+struct metrics_shard *claim_metrics_shard(struct metrics *metrics,
+                                          const char *thread_name) {
+  int index;
+
+  index = __atomic_fetch_add(&metrics->n_shards, 1, __ATOMIC_RELAXED);
+  if (METRICS_MAX_SHARDS <= index) {
+    __atomic_fetch_sub(&metrics->n_shards, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  metrics->shards[index].thread_name = thread_name;
+  return &metrics->shards[index];
+}
+
+void count_metric(struct metrics_shard *shard, enum metric_counter counter,
+                  long n) {
+  if (NULL != shard) {
+    __atomic_store_n(&shard->counters[counter], shard->counters[counter] + n,
+                     __ATOMIC_RELAXED);
+  }
+}
+
+void set_metric(struct metrics_shard *shard, enum metric_gauge gauge,
+                long value) {
+  if (NULL != shard) {
+    __atomic_store_n(&shard->gauges[gauge], value, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * Open the I/O accounting of the calling thread: ncurses writes straight to
+ * the terminal descriptor, so the bytes are metered by the kernel's count
+ */
+bool open_output_meter(struct metrics_shard *shard) {
+  if (NULL == shard) {
+    return false;
+  }
+  shard->io_fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+  return -1 != shard->io_fd;
+}
+
+/**
+ * Get the bytes written by the thread so far, or zero when unknown
+ */
+long read_output_meter(struct metrics_shard *shard) {
+  char text[512], *wchar;
+  ssize_t length;
+
+  if (NULL == shard || -1 == shard->io_fd) {
+    return 0L;
+  }
+  length = pread(shard->io_fd, text, sizeof(text) - 1, 0);
+  if (0 >= length) {
+    return 0L;
+  }
+  text[length] = '\0';
+  wchar = strstr(text, "wchar: ");
+  return (NULL == wchar) ? 0L : atol(wchar + strlen("wchar: "));
+}
+
+void close_output_meter(struct metrics_shard *shard) {
+  if (NULL != shard && -1 != shard->io_fd) {
+    close(shard->io_fd);
+    shard->io_fd = -1;
+  }
+}
+
+static void write_metric_family(FILE *file, struct metrics *metrics,
+                                const char *const names[2], const char *type,
+                                bool counter, int index) {
+  int i, n_shards;
+  const struct metrics_shard *shard;
+
+  fprintf(file, "# HELP %s %s\n# TYPE %s %s\n", names[0], names[1], names[0],
+          type);
+  n_shards = __atomic_load_n(&metrics->n_shards, __ATOMIC_RELAXED);
+  for (i = 0; i < n_shards && METRICS_MAX_SHARDS > i; ++i) {
+    shard = &metrics->shards[i];
+    fprintf(file, "%s{instance=\"%ld\",thread=\"%s\"} %ld\n", names[0],
+            metrics->instance, shard->thread_name,
+            counter ?
+                __atomic_load_n(&shard->counters[index], __ATOMIC_RELAXED) :
+                __atomic_load_n(&shard->gauges[index], __ATOMIC_RELAXED));
+  }
+}
+
+/**
+ * Write all the shards into a temporary file of a unique name and rename it
+ * over the path, so that a scraper never reads a half-written one
+ */
+bool publish_metrics(struct metrics *metrics) {
+  int i, fd;
+  char temporary_path[METRICS_FILEPATH_MAX_LENGTH + 8];
+  FILE *file;
+
+  snprintf(temporary_path, sizeof(temporary_path), "%s.XXXXXX",
+           metrics->path);
+  fd = mkstemp(temporary_path);
+  if (-1 == fd) {
+    return false;
+  }
+  fchmod(fd, 0644);
+  file = fdopen(fd, "w");
+  if (NULL == file) {
+    close(fd);
+    remove(temporary_path);
+    return false;
+  }
+  for (i = 0; i < N_METRIC_COUNTERS; ++i) {
+    write_metric_family(file, metrics, counter_names[i], "counter", true, i);
+  }
+  for (i = 0; i < N_METRIC_GAUGES; ++i) {
+    write_metric_family(file, metrics, gauge_names[i], "gauge", false, i);
+  }
+  if (0 != fclose(file)) {
+    remove(temporary_path);
+    return false;
+  }
+  if (0 != rename(temporary_path, metrics->path)) {
+    remove(temporary_path);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Take the published file away on the way out, so that a scraper does not
+ * keep reporting the last counters of an instance which is gone
+ */
+void retract_metrics(struct metrics *metrics) {
+  unlink(metrics->path);
+}
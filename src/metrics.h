@@ -0,0 +1,64 @@
+/*
+ * metrics.h
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdbool.h>
+
+#include "invaders_config.h"
+
+enum metric_counter {
+  TICKS_METRIC = 0,
+  FRAMES_RENDERED_METRIC,
+  LATE_FRAMES_METRIC,
+  OUTPUT_BYTES_METRIC,
+  GAMES_STARTED_METRIC,
+  GAME_CLEARS_METRIC,
+  GAME_OVERS_METRIC,
+  N_METRIC_COUNTERS,
+};
+
+enum metric_gauge {
+  LEVEL_SPEED_METRIC = 0,
+  ACTIVE_BULLETS_METRIC,
+  N_METRIC_GAUGES,
+};
+
+/**
+ * The metrics of one thread; only that thread writes them, so the updates
+ * are plain atomic stores, and the shards never share a cache line
+ */
+struct metrics_shard {
+  const char *thread_name;
+  int io_fd;
+  long counters[N_METRIC_COUNTERS];
+  long gauges[N_METRIC_GAUGES];
+} __attribute__((aligned(64)));
+
+/**
+ * The shards of a process, published together as a text file in the
+ * Prometheus exposition format
+ */
+struct metrics {
+  char path[METRICS_FILEPATH_MAX_LENGTH];
+  long instance;
+  int n_shards;
+  struct metrics_shard shards[METRICS_MAX_SHARDS];
+};
+
+extern void reset_metrics(struct metrics *metrics, const char *path_format);
+extern struct metrics_shard *claim_metrics_shard(struct metrics *metrics,
+                                                 const char *thread_name);
+extern void count_metric(struct metrics_shard *shard,
+                         enum metric_counter counter, long n);
+extern void set_metric(struct metrics_shard *shard, enum metric_gauge gauge,
+                       long value);
+extern bool open_output_meter(struct metrics_shard *shard);
+extern long read_output_meter(struct metrics_shard *shard);
+extern void close_output_meter(struct metrics_shard *shard);
+extern bool publish_metrics(struct metrics *metrics);
+extern void retract_metrics(struct metrics *metrics);
+
+#endif /* METRICS_H_ */
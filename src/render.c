@@ -0,0 +1,142 @@
+/*
+ * render.c
+ */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ncurses.h>
+
+#include "render.h"
+
+void reset_render_buffer(struct render_buffer *buffer) {
+  buffer->n_commands = 0;
+  buffer->frame_color_switches = 0;
+  buffer->n_frames = 0L;
+  buffer->n_color_switches = 0L;
+  buffer->n_dropped_commands = 0L;
+}
+
+static struct render_command *push_command(struct render_buffer *buffer,
+                                           enum render_command_type type,
+                                           enum render_layer layer,
+                                           int color_pair, int x, int y) {
+  struct render_command *command;
+
+  /* The capacity covers the worst frame; running out means it is stale */
+  assert(N_RENDER_COMMANDS > buffer->n_commands);
+  if (N_RENDER_COMMANDS <= buffer->n_commands) {
+    ++buffer->n_dropped_commands;
+    return NULL;
+  }
+  command = &buffer->commands[buffer->n_commands];
+  command->type = type;
+  command->layer = layer;
+  command->color_pair = color_pair;
+  command->sequence = buffer->n_commands;
+  command->position.x = x;
+  command->position.y = y;
+  ++buffer->n_commands;
+  return command;
+}
+
+void push_sprite_command(struct render_buffer *buffer,
+                         const struct sprite *sprite, int x, int y) {
+  struct render_command *command;
+
+  command = push_command(buffer, SPRITE_RENDER_COMMAND, ENTITY_RENDER_LAYER,
+                         sprite->color_pair, x, y);
+  if (NULL != command) {
+    command->sprite = sprite;
+  }
+}
+
+void push_cell_run_command(struct render_buffer *buffer,
+                           enum render_layer layer, chtype cell, int x, int y,
+                           int length, bool vertical) {
+  struct render_command *command;
+
+  command = push_command(buffer, CELL_RUN_RENDER_COMMAND, layer,
+                         PAIR_NUMBER(cell), x, y);
+  if (NULL != command) {
+    command->cell = cell;
+    command->length = length;
+    command->vertical = vertical;
+  }
+}
+
+void push_text_command(struct render_buffer *buffer, enum render_layer layer,
+                       int color_pair, int x, int y, const char *format, ...) {
+  struct render_command *command;
+  va_list args;
+
+  command = push_command(buffer, TEXT_RENDER_COMMAND, layer, color_pair, x, y);
+  if (NULL != command) {
+    va_start(args, format);
+    vsnprintf(command->text, sizeof(command->text), format, args);
+    va_end(args);
+  }
+}
+
+static int compare_render_commands(const void *one, const void *theother) {
+  const struct render_command *lhs = one;
+  const struct render_command *rhs = theother;
+
+  if (lhs->layer != rhs->layer) {
+    return (lhs->layer < rhs->layer) ? -1 : 1;
+  }
+  if (lhs->color_pair != rhs->color_pair) {
+    return (lhs->color_pair < rhs->color_pair) ? -1 : 1;
+  }
+  if (lhs->position.x != rhs->position.x) {
+    return (lhs->position.x < rhs->position.x) ? -1 : 1;
+  }
+  return (lhs->sequence < rhs->sequence) ? -1 : 1;
+}
+
+/**
+ * Sort the recorded commands and send them to the window, switching the
+ * attributes only when the color pair of the next command differs
+ */
+void flush_render_buffer(struct render_buffer *buffer, WINDOW *window) {
+  int i, current_color_pair;
+  struct render_command *command;
+
+  qsort(buffer->commands, buffer->n_commands, sizeof(buffer->commands[0]),
+        compare_render_commands);
+  buffer->frame_color_switches = 0;
+  current_color_pair = -1;
+  for (i = 0; i < buffer->n_commands; ++i) {
+    command = &buffer->commands[i];
+    if (current_color_pair != command->color_pair) {
+      current_color_pair = command->color_pair;
+      wattrset(window, COLOR_PAIR(current_color_pair));
+      ++buffer->frame_color_switches;
+    }
+    switch (command->type) {
+      case SPRITE_RENDER_COMMAND:
+        draw_sprite(window, command->sprite, command->position.x,
+                    command->position.y);
+        break;
+      case CELL_RUN_RENDER_COMMAND:
+        if (command->vertical) {
+          mvwvline(window, command->position.x, command->position.y,
+                   command->cell, command->length);
+        } else {
+          draw_cell_run(window, command->cell, command->position.x,
+                        command->position.y, command->length);
+        }
+        break;
+      case TEXT_RENDER_COMMAND:
+        mvwaddstr(window, command->position.x, command->position.y,
+                  command->text);
+        break;
+    }
+  }
+  wattrset(window, A_NORMAL);
+  buffer->n_commands = 0;
+  ++buffer->n_frames;
+  buffer->n_color_switches += buffer->frame_color_switches;
+}
@@ -0,0 +1,65 @@
+/*
+ * render.h
+ */
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include <stdbool.h>
+#include <ncurses.h>
+
+#include "invaders_config.h"
+#include "sprite.h"
+#include "utility.h"
+
+#define RENDER_TEXT_MAX_LENGTH (32)
+
+enum render_layer {
+  ENTITY_RENDER_LAYER = 0,
+  HUD_RENDER_LAYER,
+};
+
+enum render_command_type {
+  SPRITE_RENDER_COMMAND,
+  CELL_RUN_RENDER_COMMAND,
+  TEXT_RENDER_COMMAND,
+};
+
+struct render_command {
+  enum render_command_type type;
+  enum render_layer layer;
+  int color_pair;
+  int sequence;
+  struct vector2 position;
+  const struct sprite *sprite;
+  chtype cell;
+  int length;
+  bool vertical;
+  char text[RENDER_TEXT_MAX_LENGTH];
+};
+
+/**
+ * Draws recorded during a frame, sent to the window grouped by the layer,
+ * the color pair and the row so that the attribute changes once per group
+ */
+struct render_buffer {
+  int n_commands;
+  struct render_command commands[N_RENDER_COMMANDS];
+  int frame_color_switches;
+  long n_frames;
+  long n_color_switches;
+  long n_dropped_commands;
+};
+
+extern void reset_render_buffer(struct render_buffer *buffer);
+extern void push_sprite_command(struct render_buffer *buffer,
+                                const struct sprite *sprite, int x, int y);
+extern void push_cell_run_command(struct render_buffer *buffer,
+                                  enum render_layer layer, chtype cell, int x,
+                                  int y, int length, bool vertical);
+extern void push_text_command(struct render_buffer *buffer,
+                              enum render_layer layer, int color_pair, int x,
+                              int y, const char *format, ...);
+extern void flush_render_buffer(struct render_buffer *buffer, WINDOW *window);
+
+#endif /* RENDER_H_ */
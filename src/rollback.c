@@ -0,0 +1,270 @@
+/*
+ * rollback.c
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <ncurses.h>
+
+#include "rollback.h"
+
+void reset_rollback(struct rollback *rollback, int local_player) {
+  int i;
+
+  rollback->local_player = local_player;
+  rollback->remote_player = 1 - local_player;
+  rollback->tick = 0;
+  rollback->confirmed_tick = 0;
+  rollback->checksummed_tick = 0;
+  rollback->mispredicted_tick = -1;
+  rollback->n_rollbacks = 0L;
+  rollback->n_resimulated_ticks = 0L;
+  rollback->max_rollback_ticks = 0;
+  rollback->total_rollback_nsec = 0L;
+  rollback->max_rollback_nsec = 0L;
+  for (i = 0; i < ROLLBACK_WINDOW; ++i) {
+    rollback->pending_keys[i].tick = -1;
+    rollback->frames[i].tick = -1;
+  }
+}
+
+/**
+ * Tell whether the local player is still within the window ahead of the
+ * confirmed keys; past it the frames to roll back to would be overwritten
+ */
+bool can_advance_rollback(const struct rollback *rollback) {
+  return ROLLBACK_WINDOW - 1 > rollback->tick - rollback->confirmed_tick;
+}
+
+/**
+ * Get the whole milliseconds of the tick, carrying the fractions over to
+ * the next, so that both peers simulate the same time on the same tick
+ */
+long get_tick_elapsed_time(int32_t tick) {
+  long tick_nsec;
+
+  tick_nsec = 1000000000L / SIMULATION_TICK_RATE;
+  return (tick + 1L) * tick_nsec / 1000000L - tick * tick_nsec / 1000000L;
+}
+
+static uint32_t hash_bytes(uint32_t hash, const void *bytes, size_t length) {
+  const uint8_t *p = bytes;
+  size_t i;
+
+  for (i = 0; i < length; ++i) {
+    hash = (hash ^ p[i]) * 16777619U;
+  }
+  return hash;
+}
+
+#define HASH_FIELD(_hash, _field) \
+  hash_bytes((_hash), &(_field), sizeof(_field))
+
+static uint32_t hash_timer(uint32_t hash, const struct timer *timer) {
+  hash = HASH_FIELD(hash, timer->counter);
+  return HASH_FIELD(hash, timer->alarm_interval);
+}
+
+static uint32_t hash_behaviour(uint32_t hash,
+                               const struct behaviour_scheduler *scheduler) {
+  int i;
+  const struct behaviour_script *script;
+
+  hash = HASH_FIELD(hash, scheduler->clocks);
+  hash = HASH_FIELD(hash, scheduler->next_wake_times);
+  hash = HASH_FIELD(hash, scheduler->n_scripts);
+  for (i = 0; i < scheduler->n_scripts; ++i) {
+    script = &scheduler->scripts[i];
+    hash = HASH_FIELD(hash, script->wake_time);
+    hash = HASH_FIELD(hash, script->resume_point);
+    hash = HASH_FIELD(hash, script->clock);
+  }
+  return hash;
+}
+
+/**
+ * Hash the state both peers must agree on, down to the timers and the wake
+ * times driving the invaders, field by field to leave the padding out
+ */
+uint32_t get_session_checksum(const struct game_session *session) {
+  uint32_t hash;
+  const struct invaders_game *game = &session->game;
+  const struct entity_store *entities = &game->entities;
+
+  hash = 2166136261U;
+  hash = HASH_FIELD(hash, session->scene);
+  hash = HASH_FIELD(hash, session->next_scene);
+  hash = HASH_FIELD(hash, session->next_seed);
+  if (INGAME_SCENE != session->scene) {
+    return hash;
+  }
+  hash = HASH_FIELD(hash, game->pending_time);
+  hash = HASH_FIELD(hash, game->play_time);
+  hash = HASH_FIELD(hash, game->random_state);
+  hash = HASH_FIELD(hash, game->event);
+  hash = HASH_FIELD(hash, game->n_players);
+  hash = HASH_FIELD(hash, game->formation_speed_y);
+  hash = hash_timer(hash, &game->shooting_timer);
+  hash = hash_behaviour(hash, &game->behaviour);
+  hash = HASH_FIELD(hash, entities->moving_timers);
+  hash = HASH_FIELD(hash, entities->velocities);
+  hash = HASH_FIELD(hash, entities->block_standings);
+  hash = HASH_FIELD(hash, entities->positions);
+  hash = HASH_FIELD(hash, entities->sizes);
+  hash = HASH_FIELD(hash, entities->types);
+  hash = HASH_FIELD(hash, entities->sprites);
+  hash = HASH_FIELD(hash, entities->collision_layers);
+  hash = HASH_FIELD(hash, entities->alive);
+  hash = HASH_FIELD(hash, game->score);
+  hash = HASH_FIELD(hash, game->credit);
+  hash = HASH_FIELD(hash, game->seed);
+  hash = hash_timer(hash, &game->event_caption.timer);
+  return HASH_FIELD(hash, game->event_caption.displaying);
+}
+
+/**
+ * Take the confirmed key of the remote player; a key differing from the one
+ * a simulated tick was predicted with marks the tick to roll back to
+ */
+void confirm_remote_key(struct rollback *rollback, int32_t tick, int key) {
+  struct rollback_frame *frame;
+  struct pending_key *pending;
+
+  if (tick < rollback->confirmed_tick) {
+    return;
+  }
+  if (tick < rollback->tick) {
+    frame = &rollback->frames[tick % ROLLBACK_WINDOW];
+    if (key != frame->keys[rollback->remote_player]
+        && (0 > rollback->mispredicted_tick
+            || tick < rollback->mispredicted_tick)) {
+      rollback->mispredicted_tick = tick;
+    }
+    frame->keys[rollback->remote_player] = key;
+    frame->confirmed = true;
+  } else {
+    pending = &rollback->pending_keys[tick % ROLLBACK_WINDOW];
+    pending->tick = tick;
+    pending->key = key;
+  }
+
+  /* The keys come in order, but do not count on it */
+  while (true) {
+    if (rollback->confirmed_tick < rollback->tick) {
+      frame = &rollback->frames[rollback->confirmed_tick % ROLLBACK_WINDOW];
+      if (!frame->confirmed) {
+        break;
+      }
+    } else {
+      pending = &rollback->pending_keys[rollback->confirmed_tick
+                                        % ROLLBACK_WINDOW];
+      if (rollback->confirmed_tick != pending->tick) {
+        break;
+      }
+    }
+    ++rollback->confirmed_tick;
+  }
+}
+
+/**
+ * Save the state the tick starts from and simulate the tick
+ */
+static void simulate_tick(struct rollback *rollback,
+                          struct game_session *session, int32_t tick) {
+  struct rollback_frame *frame;
+
+  frame = &rollback->frames[tick % ROLLBACK_WINDOW];
+  memcpy(&frame->session, session, sizeof(frame->session));
+  update_game_session_with_keys(session, frame->keys,
+                                get_tick_elapsed_time(tick));
+}
+
+/**
+ * Checksum the state after each tick simulated on confirmed keys only; it
+ * is the state the next frame starts from, or the session after the last
+ */
+static void take_checksums(struct rollback *rollback,
+                           const struct game_session *session) {
+  int32_t tick;
+  const struct game_session *after;
+
+  while (rollback->checksummed_tick < rollback->confirmed_tick
+      && rollback->checksummed_tick < rollback->tick) {
+    tick = rollback->checksummed_tick;
+    after = (tick + 1 < rollback->tick) ?
+        &rollback->frames[(tick + 1) % ROLLBACK_WINDOW].session : session;
+    rollback->frames[tick % ROLLBACK_WINDOW].checksum =
+        get_session_checksum(after);
+    ++rollback->checksummed_tick;
+  }
+}
+
+/**
+ * Simulate the next tick on the local key and the remote key, confirmed or
+ * predicted, after simulating again the ticks since a misprediction
+ */
+void advance_rollback(struct rollback *rollback, struct game_session *session,
+                      int local_key) {
+  int i, n_ticks;
+  int32_t tick;
+  long start_nsec, rollback_nsec;
+  struct rollback_frame *frame;
+  struct pending_key *pending;
+
+  if (0 <= rollback->mispredicted_tick) {
+    start_nsec = get_clock_nsec(CLOCK_MONOTONIC);
+    n_ticks = rollback->tick - rollback->mispredicted_tick;
+    memcpy(session,
+           &rollback->frames[rollback->mispredicted_tick
+                             % ROLLBACK_WINDOW].session,
+           sizeof(*session));
+    for (tick = rollback->mispredicted_tick; tick < rollback->tick; ++tick) {
+      simulate_tick(rollback, session, tick);
+    }
+    rollback->mispredicted_tick = -1;
+    rollback_nsec = get_clock_nsec(CLOCK_MONOTONIC) - start_nsec;
+    ++rollback->n_rollbacks;
+    rollback->n_resimulated_ticks += n_ticks;
+    rollback->total_rollback_nsec += rollback_nsec;
+    if (rollback->max_rollback_ticks < n_ticks) {
+      rollback->max_rollback_ticks = n_ticks;
+    }
+    if (rollback->max_rollback_nsec < rollback_nsec) {
+      rollback->max_rollback_nsec = rollback_nsec;
+    }
+  }
+
+  /* Predict no key from the remote player unless it has already come */
+  tick = rollback->tick;
+  frame = &rollback->frames[tick % ROLLBACK_WINDOW];
+  pending = &rollback->pending_keys[tick % ROLLBACK_WINDOW];
+  frame->tick = tick;
+  for (i = 0; i < MAX_PLAYERS; ++i) {
+    frame->keys[i] = ERR;
+  }
+  frame->keys[rollback->local_player] = local_key;
+  frame->confirmed = (tick == pending->tick);
+  if (frame->confirmed) {
+    frame->keys[rollback->remote_player] = pending->key;
+  }
+  simulate_tick(rollback, session, tick);
+  ++rollback->tick;
+  take_checksums(rollback, session);
+}
+
+bool get_rollback_checksum(const struct rollback *rollback, int32_t tick,
+                           uint32_t *checksum) {
+  const struct rollback_frame *frame;
+
+  if (0 > tick || tick >= rollback->checksummed_tick) {
+    return false;
+  }
+  frame = &rollback->frames[tick % ROLLBACK_WINDOW];
+  if (tick != frame->tick) {
+    return false;
+  }
+  *checksum = frame->checksum;
+  return true;
+}
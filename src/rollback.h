@@ -0,0 +1,71 @@
+/*
+ * rollback.h
+ */
+
+#ifndef ROLLBACK_H_
+#define ROLLBACK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+#include "invaders_config.h"
+
+/**
+ * A simulated tick of the versus session: the keys of both players, and the
+ * state the tick starts from, to go back to on a misprediction
+ */
+struct rollback_frame {
+  int32_t tick;
+  bool confirmed;
+  uint32_t checksum;
+  int keys[MAX_PLAYERS];
+  struct game_session session;
+};
+
+/**
+ * A key of the remote player arrived ahead of the local simulation
+ */
+struct pending_key {
+  int32_t tick;
+  int key;
+};
+
+/**
+ * Runs the session ahead on the predicted key of the remote player, and
+ * once the real key turns out different, restores the state of that tick
+ * and simulates the ticks since again. The frames make a ring over the
+ * window the local player may run ahead of the confirmed keys.
+ */
+struct rollback {
+  int local_player;
+  int remote_player;
+  /* The tick simulated next */
+  int32_t tick;
+  /* The ticks before it have the keys of both players */
+  int32_t confirmed_tick;
+  /* The ticks before it have their checksum taken */
+  int32_t checksummed_tick;
+  /* The earliest tick simulated on a wrong prediction, or -1 */
+  int32_t mispredicted_tick;
+  long n_rollbacks;
+  long n_resimulated_ticks;
+  int max_rollback_ticks;
+  long total_rollback_nsec;
+  long max_rollback_nsec;
+  struct pending_key pending_keys[ROLLBACK_WINDOW];
+  struct rollback_frame frames[ROLLBACK_WINDOW];
+};
+
+extern void reset_rollback(struct rollback *rollback, int local_player);
+extern bool can_advance_rollback(const struct rollback *rollback);
+extern void confirm_remote_key(struct rollback *rollback, int32_t tick,
+                               int key);
+extern void advance_rollback(struct rollback *rollback,
+                             struct game_session *session, int local_key);
+extern bool get_rollback_checksum(const struct rollback *rollback,
+                                  int32_t tick, uint32_t *checksum);
+extern long get_tick_elapsed_time(int32_t tick);
+extern uint32_t get_session_checksum(const struct game_session *session);
+
+#endif /* ROLLBACK_H_ */
@@ -0,0 +1,182 @@
+/*
+ * score_store.c
+ */
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "score_store.h"
+
+#define SCORE_STORE_INDEX_BITS (24)
+#define SCORE_STORE_INDEX_MASK ((UINT64_C(1) << SCORE_STORE_INDEX_BITS) - 1)
+#define SCORE_STORE_SCORE_MAX ((INT64_C(1) << (64 - SCORE_STORE_INDEX_BITS)) - 1)
+
+/**
+ * Pack the score over the record index, so that the words compare as the
+ * scores do; the index is biased by one to leave zero for the empty slot
+ */
+static uint64_t pack_top_score(int64_t score, uint64_t index) {
+  if (0 > score) {
+    score = 0;
+  } else if (SCORE_STORE_SCORE_MAX < score) {
+    score = SCORE_STORE_SCORE_MAX;
+  }
+  return ((uint64_t) score << SCORE_STORE_INDEX_BITS) | (index + 1);
+}
+
+bool open_score_store(struct score_store *store, const char *path) {
+  struct stat status;
+  bool stamped;
+
+  store->file = NULL;
+  store->size = sizeof(struct score_store_file)
+      + sizeof(struct game_record) * SCORE_STORE_CAPACITY;
+  store->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (-1 == store->fd) {
+    return false;
+  }
+
+  /* Extend the file up to the full capacity; it stays sparse until used */
+  if (-1 == fstat(store->fd, &status)
+      || ((off_t) store->size > status.st_size
+          && -1 == ftruncate(store->fd, store->size))) {
+    close(store->fd);
+    return false;
+  }
+  store->file = mmap(NULL, store->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     store->fd, 0);
+  if (MAP_FAILED == store->file) {
+    store->file = NULL;
+    close(store->fd);
+    return false;
+  }
+
+  /*
+   * The first process to map a new file stamps its header, under a lock the
+   * kernel lets go of even when the process dies halfway
+   */
+  if (-1 == flock(store->fd, LOCK_EX)) {
+    close_score_store(store);
+    return false;
+  }
+  if (0 == store->file->magic) {
+    store->file->record_size = sizeof(struct game_record);
+    store->file->capacity = SCORE_STORE_CAPACITY;
+    store->file->magic = SCORE_STORE_MAGIC;
+  }
+  stamped = SCORE_STORE_MAGIC == store->file->magic
+      && sizeof(struct game_record) == store->file->record_size
+      && SCORE_STORE_CAPACITY == store->file->capacity;
+  flock(store->fd, LOCK_UN);
+  if (!stamped) {
+    close_score_store(store);
+    return false;
+  }
+  return true;
+}
+
+void close_score_store(struct score_store *store) {
+  if (NULL != store->file) {
+    munmap(store->file, store->size);
+    store->file = NULL;
+    close(store->fd);
+  }
+}
+
+/**
+ * Replace the lowest word of the top scores unless the new one is lower,
+ * retrying when another writer has changed the slot in the meantime
+ */
+static void index_top_score(struct score_store_file *file, uint64_t word) {
+  int i, lowest;
+  uint64_t lowest_word, current_word;
+
+  while (true) {
+    lowest = 0;
+    lowest_word = __atomic_load_n(&file->top_scores[0], __ATOMIC_RELAXED);
+    for (i = 1; i < SCORE_STORE_TOP_N; ++i) {
+      current_word = __atomic_load_n(&file->top_scores[i], __ATOMIC_RELAXED);
+      if (lowest_word > current_word) {
+        lowest = i;
+        lowest_word = current_word;
+      }
+    }
+    if (lowest_word >= word) {
+      return;
+    }
+    if (__atomic_compare_exchange_n(&file->top_scores[lowest], &lowest_word,
+                                    word, false, __ATOMIC_RELEASE,
+                                    __ATOMIC_RELAXED)) {
+      return;
+    }
+  }
+}
+
+bool append_game_record(struct score_store *store,
+                        const struct game_record *record) {
+  uint64_t index;
+  struct game_record *slot;
+
+  if (NULL == store || NULL == store->file) {
+    return false;
+  }
+  index = __atomic_fetch_add(&store->file->n_records, 1, __ATOMIC_RELAXED);
+  if (SCORE_STORE_CAPACITY <= index) {
+    __atomic_fetch_sub(&store->file->n_records, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+  slot = &store->file->records[index];
+  memcpy(slot, record, sizeof(*slot));
+  slot->committed = 0;
+  /* Readers skip the slot until the record is whole */
+  __atomic_store_n(&slot->committed, 1, __ATOMIC_RELEASE);
+  if (0 < record->score) {
+    index_top_score(store->file, pack_top_score(record->score, index));
+  }
+  return true;
+}
+
+static int compare_top_scores(const void *one, const void *theother) {
+  uint64_t lhs = *(const uint64_t *) one;
+  uint64_t rhs = *(const uint64_t *) theother;
+
+  return (lhs == rhs) ? 0 : (lhs > rhs) ? -1 : 1;
+}
+
+/**
+ * Copy the best committed records out in the descending order of the score
+ */
+int read_top_scores(struct score_store *store, struct game_record *records,
+                    int max_records) {
+  int i, n_records;
+  uint64_t words[SCORE_STORE_TOP_N], index;
+  const struct game_record *record;
+
+  if (NULL == store || NULL == store->file) {
+    return 0;
+  }
+  for (i = 0; i < SCORE_STORE_TOP_N; ++i) {
+    words[i] = __atomic_load_n(&store->file->top_scores[i], __ATOMIC_ACQUIRE);
+  }
+  qsort(words, SCORE_STORE_TOP_N, sizeof(words[0]), compare_top_scores);
+  n_records = 0;
+  for (i = 0; i < SCORE_STORE_TOP_N && n_records < max_records; ++i) {
+    index = words[i] & SCORE_STORE_INDEX_MASK;
+    if (0 == index || SCORE_STORE_CAPACITY < index) {
+      continue;
+    }
+    record = &store->file->records[index - 1];
+    if (__atomic_load_n(&record->committed, __ATOMIC_ACQUIRE)) {
+      memcpy(&records[n_records], record, sizeof(records[n_records]));
+      ++n_records;
+    }
+  }
+  return n_records;
+}
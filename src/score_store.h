@@ -0,0 +1,56 @@
+/*
+ * score_store.h
+ */
+
+#ifndef SCORE_STORE_H_
+#define SCORE_STORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "invaders_config.h"
+
+/**
+ * A completed game, appended to the store when its caption is over
+ */
+struct game_record {
+  int64_t score;
+  int64_t finished_time;
+  int32_t duration;
+  uint32_t seed;
+  int16_t credit;
+  uint8_t outcome;
+  uint8_t committed;
+  uint8_t padding[4];
+};
+
+/**
+ * The layout of the store file, mapped as is into every process using it.
+ * The records are appended by reserving a slot with an atomic increment of
+ * n_records, and the best ones are indexed in top_scores as unordered
+ * words packing the score over the record index.
+ */
+struct score_store_file {
+  uint32_t magic;
+  uint32_t record_size;
+  uint64_t capacity;
+  uint64_t n_records;
+  uint64_t top_scores[SCORE_STORE_TOP_N];
+  struct game_record records[];
+};
+
+struct score_store {
+  int fd;
+  size_t size;
+  struct score_store_file *file;
+};
+
+extern bool open_score_store(struct score_store *store, const char *path);
+extern void close_score_store(struct score_store *store);
+extern bool append_game_record(struct score_store *store,
+                               const struct game_record *record);
+extern int read_top_scores(struct score_store *store,
+                           struct game_record *records, int max_records);
+
+#endif /* SCORE_STORE_H_ */
@@ -0,0 +1,56 @@
+/*
+ * sprite.c
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ncurses.h>
+
+#include "sprite.h"
+
+void compose_sprite(struct sprite *sprite, const char *const *pattern,
+                    int n_lines, chtype attrs) {
+  int i, j, head, tail;
+
+  assert(SPRITE_MAX_SIZE_X >= n_lines);
+  memset(sprite, 0, sizeof(*sprite));
+  sprite->color_pair = PAIR_NUMBER(attrs);
+  sprite->size.x = n_lines;
+  for (i = 0; i < n_lines; ++i) {
+    tail = (int) strlen(pattern[i]);
+    assert(SPRITE_MAX_SIZE_Y >= tail);
+    if (sprite->size.y < tail) {
+      sprite->size.y = tail;
+    }
+    head = 0;
+    while (head < tail && ' ' == pattern[i][head]) {
+      ++head;
+    }
+    while (tail > head && ' ' == pattern[i][tail - 1]) {
+      --tail;
+    }
+    sprite->rows[i].offset = head;
+    sprite->rows[i].length = tail - head;
+    for (j = head; j < tail; ++j) {
+      sprite->rows[i].cells[j - head] = (chtype) pattern[i][j] | attrs;
+    }
+  }
+}
+
+void draw_sprite(WINDOW *window, const struct sprite *sprite, int x, int y) {
+  int i;
+
+  for (i = 0; i < sprite->size.x; ++i) {
+    if (0 < sprite->rows[i].length) {
+      mvwaddchnstr(window, x + i, y + sprite->rows[i].offset,
+                   sprite->rows[i].cells, sprite->rows[i].length);
+    }
+  }
+}
+
+void draw_cell_run(WINDOW *window, chtype cell, int x, int y, int length) {
+  if (0 < length) {
+    mvwhline(window, x, y, cell, length);
+  }
+}
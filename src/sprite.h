@@ -0,0 +1,55 @@
+/*
+ * sprite.h
+ */
+
+#ifndef SPRITE_H_
+#define SPRITE_H_
+
+#include <stdbool.h>
+#include <ncurses.h>
+
+#include "utility.h"
+
+#define SPRITE_MAX_SIZE_X (4)
+#define SPRITE_MAX_SIZE_Y (16)
+
+enum sprite_id {
+  PLAYER_JET_SPRITE = 0,
+  PLAYER_BULLET_SPRITE,
+  COMMANDER_INVADER_SPRITE,
+  SENIOR_INVADER_SPRITE,
+  YOUNG_INVADER_SPRITE,
+  LOOKIE_INVADER_SPRITE,
+  INVADER_BULLET_SPRITE,
+  TOCHCA_BLOCK_SPRITE,
+  N_SPRITES,
+};
+
+/**
+ * One line of a sprite, precomposed with its attributes. The blank cells
+ * at both ends of the pattern are transparent and not stored.
+ */
+struct sprite_row {
+  int offset;
+  int length;
+  chtype cells[SPRITE_MAX_SIZE_Y];
+};
+
+struct sprite {
+  int color_pair;
+  struct vector2 size;
+  struct sprite_row rows[SPRITE_MAX_SIZE_X];
+};
+
+struct sprite_atlas {
+  struct sprite sprites[N_SPRITES];
+};
+
+extern void compose_sprite(struct sprite *sprite, const char *const *pattern,
+                           int n_lines, chtype attrs);
+extern void draw_sprite(WINDOW *window, const struct sprite *sprite, int x,
+                        int y);
+extern void draw_cell_run(WINDOW *window, chtype cell, int x, int y,
+                          int length);
+
+#endif /* SPRITE_H_ */
@@ -0,0 +1,318 @@
+/*
+ * trace.c
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+
+/* The largest chunk: a varint and a width per column, then 64-bit deltas */
+#define TRACE_CHUNK_MAX_SIZE \
+  (8 + N_TRACE_COLUMNS * (10 + 1 + TRACE_CHUNK_TICKS * 8))
+
+static void put_bytes(struct trace_buffer *buffer, const void *bytes,
+                      size_t length) {
+  memcpy(&buffer->bytes[buffer->length], bytes, length);
+  buffer->length += length;
+}
+
+static void put_u32(struct trace_buffer *buffer, uint32_t value) {
+  uint8_t bytes[4];
+
+  bytes[0] = (uint8_t) value;
+  bytes[1] = (uint8_t) (value >> 8);
+  bytes[2] = (uint8_t) (value >> 16);
+  bytes[3] = (uint8_t) (value >> 24);
+  put_bytes(buffer, bytes, sizeof(bytes));
+}
+
+static void put_u64(struct trace_buffer *buffer, uint64_t value) {
+  put_u32(buffer, (uint32_t) value);
+  put_u32(buffer, (uint32_t) (value >> 32));
+}
+
+static void put_varint(struct trace_buffer *buffer, uint64_t value) {
+  while (0x80U <= value) {
+    buffer->bytes[buffer->length++] = (uint8_t) (value | 0x80U);
+    value >>= 7;
+  }
+  buffer->bytes[buffer->length++] = (uint8_t) value;
+}
+
+static uint64_t encode_zigzag(int64_t value) {
+  return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int count_bit_width(uint64_t value) {
+  int width;
+
+  width = 0;
+  while (0 != value) {
+    ++width;
+    value >>= 1;
+  }
+  return width;
+}
+
+static enum trace_encoding get_column_encoding(int column) {
+  return (TOCHCA_BLOCKS_TRACE_COLUMN <= column) ?
+      XOR_TRACE_ENCODING : DELTA_TRACE_ENCODING;
+}
+
+static void get_column_name(int column, char *name, size_t size) {
+  static const char *const names[] = {
+    "formation_top", "formation_left", "formation_bottom", "formation_right",
+    "n_living_invaders", "score", "credit", "seed", "play_time",
+    "player_bullet_x", "player_bullet_y",
+  };
+
+  if (INVADER_BULLET_X_TRACE_COLUMN > column) {
+    snprintf(name, size, "%s", names[column]);
+  } else if (INVADER_BULLET_Y_TRACE_COLUMN > column) {
+    snprintf(name, size, "invader_bullet_x_%d",
+             column - INVADER_BULLET_X_TRACE_COLUMN);
+  } else if (TOCHCA_BLOCKS_TRACE_COLUMN > column) {
+    snprintf(name, size, "invader_bullet_y_%d",
+             column - INVADER_BULLET_Y_TRACE_COLUMN);
+  } else {
+    snprintf(name, size, "tochca_blocks_%d",
+             column - TOCHCA_BLOCKS_TRACE_COLUMN);
+  }
+}
+
+/**
+ * Encode the sampled chunk column by column: the first value, then the bit
+ * width and the packed zigzag deltas (or XORs) against the previous tick
+ */
+static void encode_trace_chunk(struct trace_writer *writer) {
+  int i, j, width;
+  uint64_t deltas[TRACE_CHUNK_TICKS], widest, accumulator;
+  int n_accumulated;
+  struct trace_buffer *buffer;
+
+  buffer = writer->front;
+  put_u32(buffer, TRACE_CHUNK_MAGIC);
+  put_u32(buffer, (uint32_t) writer->n_samples);
+  for (i = 0; i < N_TRACE_COLUMNS; ++i) {
+    widest = 0U;
+    for (j = 1; j < writer->n_samples; ++j) {
+      if (XOR_TRACE_ENCODING == get_column_encoding(i)) {
+        deltas[j] = (uint64_t) writer->samples[i][j]
+            ^ (uint64_t) writer->samples[i][j - 1];
+      } else {
+        deltas[j] = encode_zigzag(writer->samples[i][j]
+            - writer->samples[i][j - 1]);
+      }
+      widest |= deltas[j];
+    }
+    width = count_bit_width(widest);
+    put_varint(buffer, encode_zigzag(writer->samples[i][0]));
+    buffer->bytes[buffer->length++] = (uint8_t) width;
+
+    /* Pack the deltas from the least significant bit */
+    accumulator = 0U;
+    n_accumulated = 0;
+    for (j = 1; j < writer->n_samples && 0 < width; ++j) {
+      accumulator |= deltas[j] << n_accumulated;
+      if (64 <= n_accumulated + width) {
+        put_u64(buffer, accumulator);
+        accumulator = (0 == n_accumulated) ?
+            0U : deltas[j] >> (64 - n_accumulated);
+        n_accumulated = n_accumulated + width - 64;
+      } else {
+        n_accumulated += width;
+      }
+    }
+    while (0 < n_accumulated) {
+      buffer->bytes[buffer->length++] = (uint8_t) accumulator;
+      accumulator >>= 8;
+      n_accumulated -= 8;
+    }
+  }
+  writer->n_samples = 0;
+}
+
+static void *run_trace_writer(void *argument) {
+  struct trace_writer *writer = argument;
+  struct trace_buffer *buffer;
+
+  pthread_mutex_lock(&writer->mutex);
+  while (true) {
+    while (!writer->back_pending && !writer->closing) {
+      pthread_cond_wait(&writer->condition, &writer->mutex);
+    }
+    if (!writer->back_pending) {
+      break;
+    }
+    buffer = writer->back;
+    pthread_mutex_unlock(&writer->mutex);
+    if (buffer->length != fwrite(buffer->bytes, 1, buffer->length,
+                                 writer->file)) {
+      writer->failed = true;
+    }
+    pthread_mutex_lock(&writer->mutex);
+    writer->n_bytes += buffer->length;
+    buffer->length = 0;
+    writer->back_pending = false;
+    pthread_cond_broadcast(&writer->condition);
+  }
+  pthread_mutex_unlock(&writer->mutex);
+  return NULL;
+}
+
+/**
+ * Hand the front buffer over to the writer thread, waiting only while the
+ * thread is still busy with the previous one
+ */
+static void swap_trace_buffers(struct trace_writer *writer) {
+  struct trace_buffer *buffer;
+
+  pthread_mutex_lock(&writer->mutex);
+  while (writer->back_pending) {
+    pthread_cond_wait(&writer->condition, &writer->mutex);
+  }
+  buffer = writer->back;
+  writer->back = writer->front;
+  writer->front = buffer;
+  writer->back_pending = true;
+  pthread_cond_broadcast(&writer->condition);
+  pthread_mutex_unlock(&writer->mutex);
+}
+
+bool open_trace_writer(struct trace_writer *writer, const char *path) {
+  int i;
+  char name[32];
+  struct trace_buffer *buffer;
+
+  memset(writer, 0, sizeof(*writer));
+  writer->file = fopen(path, "wb");
+  if (NULL == writer->file) {
+    return false;
+  }
+  writer->front = &writer->buffers[0];
+  writer->back = &writer->buffers[1];
+
+  /* Describe the columns ahead of the chunks */
+  buffer = writer->front;
+  put_u32(buffer, TRACE_FILE_MAGIC);
+  put_u32(buffer, (uint32_t) N_TRACE_COLUMNS);
+  for (i = 0; i < N_TRACE_COLUMNS; ++i) {
+    get_column_name(i, name, sizeof(name));
+    buffer->bytes[buffer->length++] = (uint8_t) get_column_encoding(i);
+    put_bytes(buffer, name, strlen(name) + 1);
+  }
+
+  pthread_mutex_init(&writer->mutex, NULL);
+  pthread_cond_init(&writer->condition, NULL);
+  if (0 != pthread_create(&writer->thread, NULL, run_trace_writer, writer)) {
+    pthread_cond_destroy(&writer->condition);
+    pthread_mutex_destroy(&writer->mutex);
+    fclose(writer->file);
+    writer->file = NULL;
+    return false;
+  }
+  return true;
+}
+
+static void sample_game(struct trace_writer *writer,
+                        const struct invaders_game *game) {
+  int i, tick;
+  int64_t top, left, bottom, right, n_living_invaders;
+  const struct entity_store *entities = &game->entities;
+  const struct vector2 *position, *size;
+
+  tick = writer->n_samples;
+  top = left = INT32_MAX;
+  bottom = right = INT32_MIN;
+  n_living_invaders = 0;
+  for (i = FIRST_INVADER_ENTITY; i < FIRST_INVADER_ENTITY + N_INVADERS; ++i) {
+    if (entities->alive[i]) {
+      position = &entities->positions[i];
+      size = &entities->sizes[i];
+      ++n_living_invaders;
+      top = (top < position->x) ? top : position->x;
+      left = (left < position->y) ? left : position->y;
+      bottom = (bottom > position->x + size->x) ?
+          bottom : position->x + size->x;
+      right = (right > position->y + size->y) ?
+          right : position->y + size->y;
+    }
+  }
+  if (0 == n_living_invaders) {
+    top = left = bottom = right = 0;
+  }
+  writer->samples[FORMATION_TOP_TRACE_COLUMN][tick] = top;
+  writer->samples[FORMATION_LEFT_TRACE_COLUMN][tick] = left;
+  writer->samples[FORMATION_BOTTOM_TRACE_COLUMN][tick] = bottom;
+  writer->samples[FORMATION_RIGHT_TRACE_COLUMN][tick] = right;
+  writer->samples[N_LIVING_INVADERS_TRACE_COLUMN][tick] = n_living_invaders;
+  writer->samples[SCORE_TRACE_COLUMN][tick] = game->score;
+  writer->samples[CREDIT_TRACE_COLUMN][tick] = game->credit;
+  writer->samples[SEED_TRACE_COLUMN][tick] = game->seed;
+  writer->samples[PLAY_TIME_TRACE_COLUMN][tick] = game->play_time;
+
+  /* The inactive bullets are at the origin, which is on the canvas frame */
+  position = &entities->positions[PLAYER_BULLET_ENTITY];
+  writer->samples[PLAYER_BULLET_X_TRACE_COLUMN][tick] =
+      entities->alive[PLAYER_BULLET_ENTITY] ? position->x : 0;
+  writer->samples[PLAYER_BULLET_Y_TRACE_COLUMN][tick] =
+      entities->alive[PLAYER_BULLET_ENTITY] ? position->y : 0;
+  for (i = 0; i < N_INVADER_BULLETS; ++i) {
+    position = &entities->positions[FIRST_INVADER_BULLET_ENTITY + i];
+    writer->samples[INVADER_BULLET_X_TRACE_COLUMN + i][tick] =
+        entities->alive[FIRST_INVADER_BULLET_ENTITY + i] ? position->x : 0;
+    writer->samples[INVADER_BULLET_Y_TRACE_COLUMN + i][tick] =
+        entities->alive[FIRST_INVADER_BULLET_ENTITY + i] ? position->y : 0;
+  }
+  for (i = 0; i < N_TOCHCAS; ++i) {
+    writer->samples[TOCHCA_BLOCKS_TRACE_COLUMN + i][tick] =
+        (int64_t) entities->block_standings[FIRST_TOCHCA_ENTITY + i
+                                            - FIRST_BLOCK_ENTITY];
+  }
+  ++writer->n_samples;
+}
+
+void trace_game(struct trace_writer *writer, const struct invaders_game *game) {
+  if (NULL == writer || NULL == writer->file) {
+    return;
+  }
+  sample_game(writer, game);
+  ++writer->n_ticks;
+  if (TRACE_CHUNK_TICKS <= writer->n_samples) {
+    encode_trace_chunk(writer);
+    if (TRACE_BUFFER_SIZE < writer->front->length + TRACE_CHUNK_MAX_SIZE) {
+      swap_trace_buffers(writer);
+    }
+  }
+}
+
+/**
+ * Flush the partial chunk, wait for the writer thread and close the file
+ */
+bool close_trace_writer(struct trace_writer *writer) {
+  bool succeeded;
+
+  if (NULL == writer->file) {
+    return false;
+  }
+  if (0 < writer->n_samples) {
+    encode_trace_chunk(writer);
+  }
+  if (0 < writer->front->length) {
+    swap_trace_buffers(writer);
+  }
+  pthread_mutex_lock(&writer->mutex);
+  writer->closing = true;
+  pthread_cond_broadcast(&writer->condition);
+  pthread_mutex_unlock(&writer->mutex);
+  pthread_join(writer->thread, NULL);
+  pthread_cond_destroy(&writer->condition);
+  pthread_mutex_destroy(&writer->mutex);
+  succeeded = !writer->failed && 0 == fclose(writer->file);
+  writer->file = NULL;
+  return succeeded;
+}
@@ -0,0 +1,82 @@
+/*
+ * trace.h
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "game.h"
+#include "invaders_config.h"
+
+enum trace_column {
+  FORMATION_TOP_TRACE_COLUMN = 0,
+  FORMATION_LEFT_TRACE_COLUMN,
+  FORMATION_BOTTOM_TRACE_COLUMN,
+  FORMATION_RIGHT_TRACE_COLUMN,
+  N_LIVING_INVADERS_TRACE_COLUMN,
+  SCORE_TRACE_COLUMN,
+  CREDIT_TRACE_COLUMN,
+  SEED_TRACE_COLUMN,
+  PLAY_TIME_TRACE_COLUMN,
+  PLAYER_BULLET_X_TRACE_COLUMN,
+  PLAYER_BULLET_Y_TRACE_COLUMN,
+  INVADER_BULLET_X_TRACE_COLUMN,
+  INVADER_BULLET_Y_TRACE_COLUMN =
+      INVADER_BULLET_X_TRACE_COLUMN + N_INVADER_BULLETS,
+  TOCHCA_BLOCKS_TRACE_COLUMN =
+      INVADER_BULLET_Y_TRACE_COLUMN + N_INVADER_BULLETS,
+  N_TRACE_COLUMNS = TOCHCA_BLOCKS_TRACE_COLUMN + N_TOCHCAS,
+};
+
+/*
+ * File layout (little endian):
+ *   u32 TRACE_FILE_MAGIC, u32 n_columns,
+ *   per column: u8 encoding, NUL-terminated name
+ *   per chunk: u32 TRACE_CHUNK_MAGIC, u32 n_ticks,
+ *     per column: varint zigzag(first value), u8 width,
+ *                 (n_ticks - 1) deltas of the width, packed LSB first
+ */
+enum trace_encoding {
+  DELTA_TRACE_ENCODING = 0,
+  XOR_TRACE_ENCODING,
+};
+
+struct trace_buffer {
+  size_t length;
+  uint8_t bytes[TRACE_BUFFER_SIZE];
+};
+
+/**
+ * Samples the game every tick into column-major chunks, encodes each chunk
+ * column by column, and hands the filled buffer over to a writer thread
+ * while the other buffer takes the next chunks
+ */
+struct trace_writer {
+  FILE *file;
+  int n_samples;
+  int64_t samples[N_TRACE_COLUMNS][TRACE_CHUNK_TICKS];
+  struct trace_buffer buffers[2];
+  struct trace_buffer *front;
+  struct trace_buffer *back;
+  bool back_pending;
+  bool closing;
+  bool failed;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t condition;
+  long n_ticks;
+  long n_bytes;
+};
+
+extern bool open_trace_writer(struct trace_writer *writer, const char *path);
+extern void trace_game(struct trace_writer *writer,
+                       const struct invaders_game *game);
+extern bool close_trace_writer(struct trace_writer *writer);
+
+#endif /* TRACE_H_ */
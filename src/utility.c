@@ -8,6 +8,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "utility.h"
 
@@ -21,7 +22,7 @@ void emit_log(struct logger *logger, const char *format, ...) {
 
   if (NULL == logger->logfile) {
     /* Open the log file */
-    logger->logfile = fopen("error.log", "a");
+    logger->logfile = fopen(logger->logpath, "a");
     if (NULL == logger->logfile) {
       fprintf(stderr, "Failed to open logfile: path=%s", logger->logpath);
       return;
@@ -58,13 +59,141 @@ void clear_timer(struct timer *timer) {
   timer->counter = 0L;
 }
 
-static bool detect_collided_with_point(struct vector2 *position,
-                                       struct vector2 *size,
-                                       struct vector2 *point_position) {
-  return (position->x <= point_position->x
-      && position->x + size->x > point_position->x
-      && position->y <= point_position->y
-      && position->y + size->y > point_position->y);
+long get_clock_nsec(clockid_t clock) {
+  struct timespec now;
+
+  clock_gettime(clock, &now);
+  return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+void reset_triple_buffer(struct triple_buffer *buffer) {
+  buffer->back = 0;
+  buffer->middle = 1;
+  buffer->front = 2;
+}
+
+void publish_triple_buffer(struct triple_buffer *buffer) {
+  buffer->back = __atomic_exchange_n(&buffer->middle,
+                                     buffer->back | TRIPLE_BUFFER_DIRTY,
+                                     __ATOMIC_ACQ_REL)
+      & TRIPLE_BUFFER_INDEX_MASK;
+}
+
+bool acquire_triple_buffer(struct triple_buffer *buffer) {
+  if (0 == (__atomic_load_n(&buffer->middle, __ATOMIC_RELAXED)
+      & TRIPLE_BUFFER_DIRTY)) {
+    return false;
+  }
+  buffer->front = __atomic_exchange_n(&buffer->middle, buffer->front,
+                                      __ATOMIC_ACQ_REL)
+      & TRIPLE_BUFFER_INDEX_MASK;
+  return true;
+}
+
+void reset_key_queue(struct key_queue *queue) {
+  queue->head = 0U;
+  queue->tail = 0U;
+}
+
+bool push_key(struct key_queue *queue, const struct key_input *input) {
+  unsigned int tail;
+
+  tail = queue->tail;
+  if (KEY_QUEUE_SIZE
+      <= tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  queue->inputs[tail % KEY_QUEUE_SIZE] = *input;
+  __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool peek_key(struct key_queue *queue, struct key_input *input) {
+  unsigned int head;
+
+  head = queue->head;
+  if (head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  *input = queue->inputs[head % KEY_QUEUE_SIZE];
+  return true;
+}
+
+bool pop_key(struct key_queue *queue, struct key_input *input) {
+  if (!peek_key(queue, input)) {
+    return false;
+  }
+  __atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+void reset_latency_histogram(struct latency_histogram *histogram) {
+  int i;
+
+  for (i = 0; i < LATENCY_HISTOGRAM_N_BUCKETS; ++i) {
+    histogram->counts[i] = 0L;
+  }
+  histogram->n_samples = 0L;
+  histogram->total_usec = 0L;
+  histogram->max_usec = 0L;
+}
+
+void count_latency(struct latency_histogram *histogram, long usec) {
+  int bucket;
+
+  usec = (0L > usec) ? 0L : usec;
+  bucket = 0;
+  while (LATENCY_HISTOGRAM_N_BUCKETS - 1 > bucket && (2L << bucket) <= usec) {
+    ++bucket;
+  }
+  ++histogram->counts[bucket];
+  ++histogram->n_samples;
+  histogram->total_usec += usec;
+  histogram->max_usec = (histogram->max_usec > usec) ?
+      histogram->max_usec : usec;
+}
+
+/**
+ * Get the upper bound of the bucket holding the percentile, or the maximum
+ * when that is lower
+ */
+long get_latency_percentile(const struct latency_histogram *histogram,
+                            double percentile) {
+  int i;
+  long n_counted, bound;
+
+  n_counted = 0L;
+  for (i = 0; i < LATENCY_HISTOGRAM_N_BUCKETS; ++i) {
+    n_counted += histogram->counts[i];
+    if (0L < n_counted && histogram->n_samples * percentile <= n_counted) {
+      bound = (2L << i) - 1L;
+      return (histogram->max_usec < bound) ? histogram->max_usec : bound;
+    }
+  }
+  return histogram->max_usec;
+}
+
+void emit_latency_histogram(struct logger *logger, const char *name,
+                            const struct latency_histogram *histogram) {
+  int i;
+
+  if (0L == histogram->n_samples) {
+    return;
+  }
+  emit_log(logger,
+           "Latency: name=%s, samples=%ld, mean_usec=%ld, p50_usec=%ld, "
+           "p90_usec=%ld, p99_usec=%ld, max_usec=%ld",
+           name, histogram->n_samples,
+           histogram->total_usec / histogram->n_samples,
+           get_latency_percentile(histogram, 0.50),
+           get_latency_percentile(histogram, 0.90),
+           get_latency_percentile(histogram, 0.99), histogram->max_usec);
+  for (i = 0; i < LATENCY_HISTOGRAM_N_BUCKETS; ++i) {
+    if (0L < histogram->counts[i]) {
+      emit_log(logger, "Latency bucket: name=%s, below_usec=%ld, count=%ld",
+               name, 2L << i, histogram->counts[i]);
+    }
+  }
 }
 
 extern bool detect_collided(struct vector2 *one_position,
@@ -80,6 +209,8 @@ extern bool detect_collided(struct vector2 *one_position,
   if (NULL == theother_size) {
     theother_size = &default_size;
   }
-  return detect_collided_with_point(one_position, one_size, theother_position)
-      || detect_collided_with_point(theother_position, theother_size, one_position);
+  return (one_position->x < theother_position->x + theother_size->x
+      && theother_position->x < one_position->x + one_size->x
+      && one_position->y < theother_position->y + theother_size->y
+      && theother_position->y < one_position->y + one_size->y);
 }
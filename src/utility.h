@@ -8,7 +8,9 @@
 #ifndef UTILITY_H_
 #define UTILITY_H_
 
+#include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 
 /* Compile */
 #ifndef UNUSED
@@ -31,17 +33,79 @@ extern void close_logger(struct logger *logger);
 
 /* Time */
 struct timer {
-  long counter;
-  long alarm_interval;
+  int32_t counter;
+  int32_t alarm_interval;
 };
 extern void reset_timer(struct timer *timer, long alarm_interval);
 extern bool count_timer(struct timer *timer, long elapsed_time);
 extern void clear_timer(struct timer *timer);
+extern long get_clock_nsec(clockid_t clock);
+
+/* Concurrency */
+#define TRIPLE_BUFFER_DIRTY (4)
+#define TRIPLE_BUFFER_INDEX_MASK (3)
+#define KEY_QUEUE_SIZE (64)
+
+/**
+ * Indices into three slots held by the user: the producer fills the back
+ * slot and publishes it, the consumer takes the latest published one as the
+ * front slot, and neither of them ever waits for the other
+ */
+struct triple_buffer {
+  int back;
+  int middle;
+  int front;
+};
+extern void reset_triple_buffer(struct triple_buffer *buffer);
+extern void publish_triple_buffer(struct triple_buffer *buffer);
+extern bool acquire_triple_buffer(struct triple_buffer *buffer);
+
+/**
+ * A key with the monotonic time it was read at, and the tick applying it
+ */
+struct key_input {
+  int key;
+  long read_nsec;
+  long tick;
+};
+
+/**
+ * Lock-free queue of key inputs from one thread to another
+ */
+struct key_queue {
+  unsigned int head;
+  unsigned int tail;
+  struct key_input inputs[KEY_QUEUE_SIZE];
+};
+extern void reset_key_queue(struct key_queue *queue);
+extern bool push_key(struct key_queue *queue, const struct key_input *input);
+extern bool peek_key(struct key_queue *queue, struct key_input *input);
+extern bool pop_key(struct key_queue *queue, struct key_input *input);
+
+/* Statistics */
+#define LATENCY_HISTOGRAM_N_BUCKETS (24)
+
+/**
+ * Latencies in microseconds, counted in power-of-two buckets; the last
+ * bucket takes everything from about 8 seconds up
+ */
+struct latency_histogram {
+  long counts[LATENCY_HISTOGRAM_N_BUCKETS];
+  long n_samples;
+  long total_usec;
+  long max_usec;
+};
+extern void reset_latency_histogram(struct latency_histogram *histogram);
+extern void count_latency(struct latency_histogram *histogram, long usec);
+extern long get_latency_percentile(const struct latency_histogram *histogram,
+                                   double percentile);
+extern void emit_latency_histogram(struct logger *logger, const char *name,
+                                   const struct latency_histogram *histogram);
 
 /* Physics */
 struct vector2 {
-  int x;
-  int y;
+  int16_t x;
+  int16_t y;
 };
 
 extern bool detect_collided(struct vector2 *one_position,
@@ -0,0 +1,234 @@
+/*
+ * versus.c
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <ncurses.h>
+
+#include "versus.h"
+
+/**
+ * Connect to the peer listening on the address, or return -1 with errno
+ */
+static int connect_versus_host(const struct sockaddr_un *address) {
+  int fd, connect_errno;
+
+  fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (0 > fd) {
+    return -1;
+  }
+  if (0 != connect(fd, (const struct sockaddr *) address, sizeof(*address))) {
+    connect_errno = errno;
+    close(fd);
+    errno = connect_errno;
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Bind and listen on the path under the lock held by the caller, taking over
+ * the socket left behind when nobody listens on it; nobody is in the middle
+ * of setting up either while the lock is held
+ */
+static int listen_versus_peer(const struct sockaddr_un *address, bool stale,
+                              struct logger *error_logger) {
+  int fd;
+
+  if (stale) {
+    unlink(address->sun_path);
+  }
+  fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (0 > fd
+      || 0 != bind(fd, (const struct sockaddr *) address, sizeof(*address))) {
+    emit_log(error_logger, "Failed to listen on the versus socket: "
+             "path=%s, errno=%d", address->sun_path, errno);
+    if (0 <= fd) {
+      close(fd);
+    }
+    return -1;
+  }
+
+  /* The path is ours from here on, and goes away however the wait ends */
+  if (0 != listen(fd, 1)) {
+    emit_log(error_logger, "Failed to listen on the versus socket: "
+             "path=%s, errno=%d", address->sun_path, errno);
+    close(fd);
+    unlink(address->sun_path);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Connect to the peer listening on the path, or listen on it and wait for
+ * the peer when nobody does. The packets keep the message boundaries. The
+ * hosts take turns on a lock file beside the path, so that a socket is only
+ * taken over once it is sure nobody listens on it nor is about to.
+ */
+bool open_versus_link(struct versus_link *link, const char *path,
+                      unsigned int seed, struct logger *error_logger) {
+  int lock_fd, listening_fd, accept_errno;
+  char lock_path[sizeof(((struct sockaddr_un *) NULL)->sun_path) + 8];
+  struct sockaddr_un address;
+  struct versus_hello hello;
+
+  memset(link, 0, sizeof(*link));
+  link->fd = -1;
+  link->desynced_tick = -1;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (sizeof(address.sun_path) <= strlen(path)) {
+    emit_log(error_logger, "Too long a versus socket path: path=%s", path);
+    return false;
+  }
+  strcpy(address.sun_path, path);
+
+  /* Join as the second player, once more under the lock when nobody hosts */
+  listening_fd = -1;
+  link->fd = connect_versus_host(&address);
+  if (0 > link->fd) {
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+    lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (0 > lock_fd || 0 != flock(lock_fd, LOCK_EX)) {
+      emit_log(error_logger, "Failed to lock the versus socket: "
+               "path=%s, errno=%d", lock_path, errno);
+      if (0 <= lock_fd) {
+        close(lock_fd);
+      }
+      return false;
+    }
+    link->fd = connect_versus_host(&address);
+    if (0 > link->fd) {
+      listening_fd = listen_versus_peer(&address, ECONNREFUSED == errno,
+                                        error_logger);
+    }
+    close(lock_fd);
+    if (0 > link->fd && 0 > listening_fd) {
+      return false;
+    }
+  }
+  if (0 <= link->fd) {
+    if (sizeof(hello) != recv(link->fd, &hello, sizeof(hello), 0)
+        || VERSUS_HELLO_MAGIC != hello.magic) {
+      emit_log(error_logger, "Failed to greet the versus peer: path=%s",
+               path);
+      close_versus_link(link);
+      return false;
+    }
+    link->local_player = 1;
+    link->seed = hello.seed;
+  } else {
+    /* Host as the first player */
+    printf("Waiting for the other player on %s\n", path);
+    fflush(stdout);
+    link->fd = accept(listening_fd, NULL, NULL);
+    accept_errno = errno;
+    close(listening_fd);
+    unlink(path);
+    if (0 > link->fd) {
+      if (EINTR == accept_errno) {
+        emit_log(error_logger, "Stopped waiting for the versus peer: path=%s",
+                 path);
+      } else {
+        emit_log(error_logger, "Failed to accept the versus peer: "
+                 "path=%s, errno=%d", path, accept_errno);
+      }
+      return false;
+    }
+    hello.magic = VERSUS_HELLO_MAGIC;
+    hello.seed = seed;
+    if (sizeof(hello) != send(link->fd, &hello, sizeof(hello), 0)) {
+      emit_log(error_logger, "Failed to greet the versus peer: path=%s",
+               path);
+      close_versus_link(link);
+      return false;
+    }
+    link->local_player = 0;
+    link->seed = seed;
+  }
+  fcntl(link->fd, F_SETFL, fcntl(link->fd, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+/**
+ * Leave the peer on a failure, which it sees as the end of the stream
+ */
+static void drop_versus_peer(struct versus_link *link) {
+  shutdown(link->fd, SHUT_RDWR);
+  link->disconnected = true;
+}
+
+/**
+ * Send the key of the tick to be simulated next, with the checksum of the
+ * latest confirmed tick
+ */
+void send_versus_key(struct versus_link *link, const struct rollback *rollback,
+                     int key) {
+  struct versus_message message;
+
+  if (link->disconnected) {
+    return;
+  }
+  message.tick = rollback->tick;
+  message.key = key;
+  message.checksum_tick = rollback->checksummed_tick - 1;
+  message.checksum = 0U;
+  if (!get_rollback_checksum(rollback, message.checksum_tick,
+                             &message.checksum)) {
+    message.checksum_tick = -1;
+  }
+  if (sizeof(message) != send(link->fd, &message, sizeof(message),
+                              MSG_NOSIGNAL)) {
+    drop_versus_peer(link);
+    return;
+  }
+  ++link->n_sent;
+}
+
+/**
+ * Confirm the keys the peer has sent, and check its checksums against
+ * ours. Once the peer has left, its jet stays idle for good.
+ */
+void receive_versus_keys(struct versus_link *link, struct rollback *rollback) {
+  ssize_t length;
+  uint32_t checksum;
+  struct versus_message message;
+
+  while (!link->disconnected) {
+    length = recv(link->fd, &message, sizeof(message), 0);
+    if (0 > length && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+      return;
+    } else if (0 == length || (0 > length && EINTR != errno)) {
+      drop_versus_peer(link);
+    } else if (sizeof(message) == length) {
+      ++link->n_received;
+      confirm_remote_key(rollback, message.tick, message.key);
+      if (0 <= message.checksum_tick && !link->desynced
+          && get_rollback_checksum(rollback, message.checksum_tick, &checksum)
+          && checksum != message.checksum) {
+        link->desynced = true;
+        link->desynced_tick = message.checksum_tick;
+      }
+    }
+  }
+  while (rollback->confirmed_tick <= rollback->tick) {
+    confirm_remote_key(rollback, rollback->confirmed_tick, ERR);
+  }
+}
+
+void close_versus_link(struct versus_link *link) {
+  if (0 <= link->fd) {
+    close(link->fd);
+    link->fd = -1;
+  }
+}
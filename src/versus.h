@@ -0,0 +1,53 @@
+/*
+ * versus.h
+ */
+
+#ifndef VERSUS_H_
+#define VERSUS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rollback.h"
+#include "utility.h"
+
+/**
+ * The key of a tick, along with the checksum of a confirmed tick for the
+ * peer to check its own against
+ */
+struct versus_message {
+  int32_t tick;
+  int32_t key;
+  int32_t checksum_tick;
+  uint32_t checksum;
+};
+
+struct versus_hello {
+  uint32_t magic;
+  uint32_t seed;
+};
+
+/**
+ * A Unix socket to the other process of a two-player game. The process
+ * listening on the path is the first player and deals the seed.
+ */
+struct versus_link {
+  int fd;
+  int local_player;
+  unsigned int seed;
+  bool disconnected;
+  bool desynced;
+  int32_t desynced_tick;
+  long n_sent;
+  long n_received;
+};
+
+extern bool open_versus_link(struct versus_link *link, const char *path,
+                             unsigned int seed, struct logger *error_logger);
+extern void send_versus_key(struct versus_link *link,
+                            const struct rollback *rollback, int key);
+extern void receive_versus_keys(struct versus_link *link,
+                                struct rollback *rollback);
+extern void close_versus_link(struct versus_link *link);
+
+#endif /* VERSUS_H_ */